@@ -1,869 +1,165 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void printTwoArgs(char *s, unsigned char *code) {
-  printf("%s, %02x%02x", s, code[2], code[1]);
-}
-
-void printOneArg(char *s, unsigned char *code) {
-  printf("%s, %02x", s, code[1]);
-}
-
-int handleOpcode(unsigned char *codebuffer, int pc) {
-  unsigned char *code = &codebuffer[pc];
-  int opbytes = 1; // size of opcode
-  switch (code[0]) {
-  case 0x00:
-    printf("NOP");
-    break;
-  case 0x01:
-    printTwoArgs("LXI B", code);
-    opbytes = 3;
-    break;
-  case 0x02:
-    printf("STAX B");
-    break;
-  case 0x03:
-    printf("INX B");
-    break;
-  case 0x04:
-    printf("INR B");
-    break;
-  case 0x05:
-    printf("DCR B");
-    break;
-  case 0x06:
-    printOneArg("MVI B", code);
-    opbytes = 2;
-    break;
-  case 0x07:
-    printf("RLC");
-    break;
-  case 0x08:
-    printf("NOP");
-    break;
-  case 0x09:
-    printf("DAD B");
-    break;
-  case 0x0a:
-    printf("LDAX B");
-    break;
-  case 0x0b:
-    printf("DCX B");
-    break;
-  case 0x0c:
-    printf("INR C");
-    break;
-  case 0x0d:
-    printf("DCR");
-    break;
-  case 0x0e:
-    printOneArg("MVI C", code);
-    opbytes = 2;
-    break;
-  case 0x0f:
-    printf("RRC");
-    break;
-
-  case 0x10:
-    printf("NOP");
-    break;
-  case 0x11:
-    printTwoArgs("LXI D", code);
-    opbytes = 2;
-    break;
-  case 0x12:
-    printf("STAX D");
-    break;
-  case 0x13:
-    printf("INX D");
-    break;
-  case 0x14:
-    printf("INR D");
-    break;
-  case 0x15:
-    printf("DCR D");
-    break;
-  case 0x16:
-    printOneArg("MVI D", code);
-    opbytes = 2;
-    break;
-  case 0x17:
-    printf("RAL");
-    break;
-  case 0x18:
-    printf("NOP");
-    break;
-  case 0x19:
-    printf("DAD D");
-    break;
-  case 0x1a:
-    printf("LDAX D");
-    break;
-  case 0x1b:
-    printf("DCX D");
-    break;
-  case 0x1c:
-    printf("INR E");
-    break;
-  case 0x1d:
-    printf("DCR E");
-    break;
-  case 0x1e:
-    printOneArg("MVI E", code);
-    opbytes = 2;
-    break;
-  case 0x1f:
-    printf("RAR");
-    break;
-
-  case 0x20:
-    printf("RIM");
-    break;
-  case 0x21:
-    printTwoArgs("LXI H", code);
-    opbytes = 3;
-    break;
-  case 0x22:
-    printTwoArgs("SHLD", code);
-    opbytes = 3;
-    break;
-  case 0x23:
-    printf("INX H");
-    break;
-  case 0x24:
-    printf("INR H");
-    break;
-  case 0x25:
-    printf("DCR H");
-    break;
-  case 0x26:
-    printOneArg("MVI H", code);
-    opbytes = 2;
-    break;
-  case 0x27:
-    printf("DAA");
-    break;
-  case 0x28:
-    printf("NOP");
-    break;
-  case 0x29:
-    printf("DAD H");
-    break;
-  case 0x2a:
-    printTwoArgs("LHLD", code);
-    opbytes = 3;
-    break;
-  case 0x2b:
-    printf("DCX H");
-    break;
-  case 0x2c:
-    printf("INR L");
-    break;
-  case 0x2d:
-    printf("DCR L");
-    break;
-  case 0x2e:
-    printOneArg("MVI L", code);
-    opbytes = 2;
-    break;
-  case 0x2f:
-    printf("CMA");
-    break;
-
-  case 0x30:
-    printf("SIM");
-    break;
-  case 0x31:
-    printTwoArgs("LXI SP", code);
-    opbytes = 3;
-    break;
-  case 0x32:
-    printTwoArgs("STA", code);
-    opbytes = 3;
-    break;
-  case 0x33:
-    printf("INX SP");
-    break;
-  case 0x34:
-    printf("INR M");
-    break;
-  case 0x35:
-    printf("DCR M");
-    break;
-  case 0x36:
-    printOneArg("MVI M", code);
-    opbytes = 2;
-    break;
-  case 0x37:
-    printf("STC");
-    break;
-  case 0x38:
-    printf("NOP");
-    break;
-  case 0x39:
-    printf("DAD SP");
-    break;
-  case 0x3a:
-    printTwoArgs("LDA", code);
-    opbytes = 3;
-    break;
-  case 0x3b:
-    printf("DCX SP");
-    break;
-  case 0x3c:
-    printf("INR A");
-    break;
-  case 0x3d:
-    printf("DCR A");
-    break;
-  case 0x3e:
-    printOneArg("MVI A", code);
-    opbytes = 2;
-    break;
-  case 0x3f:
-    printf("CMC");
-    break;
+#include "cfg.h"
+#include "disasm.h"
+#include "opcodes.h"
 
-  case 0x40:
-    printf("MOV B,B");
-    break;
-  case 0x41:
-    printf("MOV B,C");
-    break;
-  case 0x42:
-    printf("MOV B,D");
-    break;
-  case 0x43:
-    printf("MOV B,E");
-    break;
-  case 0x44:
-    printf("MOV B,H");
-    break;
-  case 0x45:
-    printf("MOV B,L");
-    break;
-  case 0x46:
-    printf("MOV B,M");
-    break;
-  case 0x47:
-    printf("MOV B,A");
-    break;
-  case 0x48:
-    printf("MOV C,B");
-    break;
-  case 0x49:
-    printf("MOV C,C");
-    break;
-  case 0x4a:
-    printf("MOV C,D");
-    break;
-  case 0x4b:
-    printf("MOV C,E");
-    break;
-  case 0x4c:
-    printf("MOV C,H");
-    break;
-  case 0x4d:
-    printf("MOV C,L");
-    break;
-  case 0x4e:
-    printf("MOV C,M");
-    break;
-  case 0x4f:
-    printf("MOV C,A");
-    break;
+// Output is assembled in one large buffer and written with a single fwrite
+// whenever it fills, instead of a printf per mnemonic and operand.
+#define OUT_SIZE (1 << 16)
+#define OUT_LINE 64
 
-  case 0x50:
-    printf("MOV D,B");
-    break;
-  case 0x51:
-    printf("MOV D,C");
-    break;
-  case 0x52:
-    printf("MOV D,D");
-    break;
-  case 0x53:
-    printf("MOV D,E");
-    break;
-  case 0x54:
-    printf("MOV D,H");
-    break;
-  case 0x55:
-    printf("MOV D,L");
-    break;
-  case 0x56:
-    printf("MOV D,M");
-    break;
-  case 0x57:
-    printf("MOV D,A");
-    break;
-  case 0x58:
-    printf("MOV E,B");
-    break;
-  case 0x59:
-    printf("MOV E,C");
-    break;
-  case 0x5a:
-    printf("MOV E,D");
-    break;
-  case 0x5b:
-    printf("MOV E,E");
-    break;
-  case 0x5c:
-    printf("MOV E,H");
-    break;
-  case 0x5d:
-    printf("MOV E,L");
-    break;
-  case 0x5e:
-    printf("MOV E,M");
-    break;
-  case 0x5f:
-    printf("MOV E,A");
-    break;
-  case 0x60:
-    printf("MOV H,B");
-    break;
-  case 0x61:
-    printf("MOV H,C");
-    break;
-  case 0x62:
-    printf("MOV H,D");
-    break;
-  case 0x63:
-    printf("MOV H,E");
-    break;
-  case 0x64:
-    printf("MOV H,H");
-    break;
-  case 0x65:
-    printf("MOV H,L");
-    break;
-  case 0x66:
-    printf("MOV H,M");
-    break;
-  case 0x67:
-    printf("MOV H,A");
-    break;
-  case 0x68:
-    printf("MOV L,B");
-    break;
-  case 0x69:
-    printf("MOV L,C");
-    break;
-  case 0x6a:
-    printf("MOV L,D");
-    break;
-  case 0x6b:
-    printf("MOV L,E");
-    break;
-  case 0x6c:
-    printf("MOV L,H");
-    break;
-  case 0x6d:
-    printf("MOV L,L");
-    break;
-  case 0x6e:
-    printf("MOV L,M");
-    break;
-  case 0x6f:
-    printf("MOV L,A");
-    break;
+static char out[OUT_SIZE];
+static size_t out_len;
 
-  case 0x70:
-    printf("MOV M,B");
-    break;
-  case 0x71:
-    printf("MOV M,C");
-    break;
-  case 0x72:
-    printf("MOV M,D");
-    break;
-  case 0x73:
-    printf("MOV M,E");
-    break;
-  case 0x74:
-    printf("MOV M,H");
-    break;
-  case 0x75:
-    printf("MOV M,L");
-    break;
-  case 0x76:
-    printf("HLT");
-    break;
-  case 0x77:
-    printf("MOV M,A");
-    break;
-  case 0x78:
-    printf("MOV A,B");
-    break;
-  case 0x79:
-    printf("MOV A,C");
-    break;
-  case 0x7a:
-    printf("MOV A,D");
-    break;
-  case 0x7b:
-    printf("MOV A,E");
-    break;
-  case 0x7c:
-    printf("MOV A,H");
-    break;
-  case 0x7d:
-    printf("MOV A,L");
-    break;
-  case 0x7e:
-    printf("MOV A,M");
-    break;
-  case 0x7f:
-    printf("MOV A,A");
-    break;
-
-  case 0x80:
-    printf("ADD B");
-    break;
-  case 0x81:
-    printf("ADD C");
-    break;
-  case 0x82:
-    printf("ADD D");
-    break;
-  case 0x83:
-    printf("ADD E");
-    break;
-  case 0x84:
-    printf("ADD H");
-    break;
-  case 0x85:
-    printf("ADD L");
-    break;
-  case 0x86:
-    printf("ADD M");
-    break;
-  case 0x87:
-    printf("ADD A");
-    break;
-  case 0x88:
-    printf("ADC B");
-    break;
-  case 0x89:
-    printf("ADC C");
-    break;
-  case 0x8a:
-    printf("ADC D");
-    break;
-  case 0x8b:
-    printf("ADC E");
-    break;
-  case 0x8c:
-    printf("ADC H");
-    break;
-  case 0x8d:
-    printf("ADC L");
-    break;
-  case 0x8e:
-    printf("ADC M");
-    break;
-  case 0x8f:
-    printf("ADC A");
-    break;
+static void flushOut(void) {
+  fwrite(out, 1, out_len, stdout);
+  out_len = 0;
+}
 
-  case 0x90:
-    printf("SUB B");
-    break;
-  case 0x91:
-    printf("SUB C");
-    break;
-  case 0x92:
-    printf("SUB D");
-    break;
-  case 0x93:
-    printf("SUB E");
-    break;
-  case 0x94:
-    printf("SUB H");
-    break;
-  case 0x95:
-    printf("SUB L");
-    break;
-  case 0x96:
-    printf("SUB M");
-    break;
-  case 0x97:
-    printf("SUB A");
-    break;
-  case 0x98:
-    printf("SBB B");
-    break;
-  case 0x99:
-    printf("SBB C");
-    break;
-  case 0x9a:
-    printf("SBB D");
-    break;
-  case 0x9b:
-    printf("SBB E");
-    break;
-  case 0x9c:
-    printf("SBB H");
-    break;
-  case 0x9d:
-    printf("SBB L");
-    break;
-  case 0x9e:
-    printf("SBB M");
-    break;
-  case 0x9f:
-    printf("SBB A");
-    break;
+// Room for one more line
+static char *outLine(void) {
+  if (out_len + OUT_LINE > OUT_SIZE)
+    flushOut();
+  return &out[out_len];
+}
 
-  case 0xa0:
-    printf("ANA B");
-    break;
-  case 0xa1:
-    printf("ANA C");
-    break;
-  case 0xa2:
-    printf("ANA D");
-    break;
-  case 0xa3:
-    printf("ANA E");
-    break;
-  case 0xa4:
-    printf("ANA H");
-    break;
-  case 0xa5:
-    printf("ANA L");
-    break;
-  case 0xa6:
-    printf("ANA M");
-    break;
-  case 0xa7:
-    printf("ANA A");
-    break;
-  case 0xa8:
-    printf("XRA B");
-    break;
-  case 0xa9:
-    printf("XRA C");
-    break;
-  case 0xaa:
-    printf("XRA D");
-    break;
-  case 0xab:
-    printf("XRA E");
-    break;
-  case 0xac:
-    printf("XRA H");
-    break;
-  case 0xad:
-    printf("XRA L");
-    break;
-  case 0xae:
-    printf("XRA M");
-    break;
-  case 0xaf:
-    printf("XRA A");
-    break;
+static void endLine(char *p) {
+  *p++ = '\n';
+  out_len = p - out;
+}
 
-  case 0xb0:
-    printf("ORA B");
-    break;
-  case 0xb1:
-    printf("ORA C");
-    break;
-  case 0xb2:
-    printf("ORA D");
-    break;
-  case 0xb3:
-    printf("ORA E");
-    break;
-  case 0xb4:
-    printf("ORA H");
-    break;
-  case 0xb5:
-    printf("ORA L");
-    break;
-  case 0xb6:
-    printf("ORA M");
-    break;
-  case 0xb7:
-    printf("ORA A");
-    break;
-  case 0xb8:
-    printf("CMP B");
-    break;
-  case 0xb9:
-    printf("CMP C");
-    break;
-  case 0xba:
-    printf("CMP D");
-    break;
-  case 0xbb:
-    printf("CMP E");
-    break;
-  case 0xbc:
-    printf("CMP H");
-    break;
-  case 0xbd:
-    printf("CMP L");
-    break;
-  case 0xbe:
-    printf("CMP M");
-    break;
-  case 0xbf:
-    printf("CMP A");
-    break;
+static char *putText(char *p, const char *s) {
+  size_t len = strlen(s);
+  memcpy(p, s, len);
+  return p + len;
+}
 
-  case 0xc0:
-    printf("RNZ");
-    break;
-  case 0xc1:
-    printf("POP B");
-    break;
-  case 0xc2:
-    printTwoArgs("JNZ", code);
-    opbytes = 3;
-    break;
-  case 0xc3:
-    printTwoArgs("JMP", code);
-    opbytes = 3;
-    break;
-  case 0xc4:
-    printTwoArgs("CNZ", code);
-    opbytes = 3;
-    break;
-  case 0xc5:
-    printf("PUSH B");
-    break;
-  case 0xc6:
-    printOneArg("ADI", code);
-    opbytes = 2;
-    break;
-  case 0xc7:
-    printf("RST 0");
-    break;
-  case 0xc8:
-    printf("RZ");
-    break;
-  case 0xc9:
-    printf("RET");
-    break;
-  case 0xca:
-    printTwoArgs("JZ", code);
-    opbytes = 3;
-    break;
-  case 0xcb:
-    printf("NOP");
-    break;
-  case 0xcc:
-    printTwoArgs("CZ", code);
-    opbytes = 3;
-    break;
-  case 0xcd:
-    printTwoArgs("CALL", code);
-    opbytes = 3;
-    break;
-  case 0xce:
-    printOneArg("ACI", code);
-    opbytes = 2;
-    break;
-  case 0xcf:
-    printf("RST 1");
-    break;
+// Linear mode lists bare instructions; the control-flow listing puts the
+// address first
+int disassembleOpcode(unsigned char *codebuffer, int pc, int address) {
+  char *p = outLine();
+  if (address) {
+    p = disasmHex(p, pc, 4);
+    *p++ = ' ';
+    *p++ = ' ';
+  }
+  p += disassemble(&codebuffer[pc], p);
+  endLine(p);
+  return opcodeLength(codebuffer[pc]);
+}
 
-  case 0xd0:
-    printf("RNC");
-    break;
-  case 0xd1:
-    printf("POP D");
-    break;
-  case 0xd2:
-    printTwoArgs("JNC", code);
-    opbytes = 3;
-    break;
-  case 0xd3:
-    printOneArg("OUT", code);
-    opbytes = 2;
-    break;
-  case 0xd4:
-    printTwoArgs("CNC", code);
-    opbytes = 3;
-    break;
-  case 0xd5:
-    printf("PUSH D");
-    break;
-  case 0xd6:
-    printOneArg("SUI", code);
-    opbytes = 2;
-    break;
-  case 0xd7:
-    printf("RST 2");
-    break;
-  case 0xd8:
-    printf("RC");
-    break;
-  case 0xd9:
-    printf("NOP");
-    break;
-  case 0xda:
-    printTwoArgs("JC", code);
-    opbytes = 3;
-    break;
-  case 0xdb:
-    printOneArg("IN", code);
-    opbytes = 2;
-    break;
-  case 0xdc:
-    printTwoArgs("CC", code);
-    opbytes = 3;
-    break;
-  case 0xdd:
-    printf("NOP");
-    break;
-  case 0xde:
-    printOneArg("SBI", code);
-    opbytes = 2;
-    break;
-  case 0xdf:
-    printf("RST 3");
-    break;
+// Bytes no reached instruction covers, 8 per line
+static void printData(unsigned char *buffer, int start, int end) {
+  for (int addr = start; addr < end; addr += 8) {
+    char *p = outLine();
+    p = disasmHex(p, addr, 4);
+    p = putText(p, "  DB ");
+    for (int i = addr; i < end && i < addr + 8; i++) {
+      if (i != addr)
+        *p++ = ',';
+      p = disasmHex(p, buffer[i], 2);
+    }
+    endLine(p);
+  }
+}
 
-  case 0xe0:
-    printf("RPO");
-    break;
-  case 0xe1:
-    printf("POP H");
-    break;
-  case 0xe2:
-    printTwoArgs("JPO", code);
-    opbytes = 3;
-    break;
-  case 0xe3:
-    printf("XTHL");
-    break;
-  case 0xe4:
-    printTwoArgs("CPO", code);
-    opbytes = 3;
-    break;
-  case 0xe5:
-    printf("PUSH H");
-    break;
-  case 0xe6:
-    printOneArg("ANI", code);
-    opbytes = 2;
-    break;
-  case 0xe7:
-    printf("RST 4");
-    break;
-  case 0xe8:
-    printf("RPE");
-    break;
-  case 0xe9:
-    printf("PCHL");
-    break;
-  case 0xea:
-    printTwoArgs("JPE", code);
-    opbytes = 3;
-    break;
-  case 0xeb:
-    printf("XCHG");
-    break;
-  case 0xec:
-    printTwoArgs("CPE", code);
-    opbytes = 3;
-    break;
-  case 0xed:
-    printf("NOP");
-    break;
-  case 0xee:
-    printOneArg("XRI", code);
-    opbytes = 2;
-    break;
-  case 0xef:
-    printf("RST 5");
-    break;
+static void printLabel(const char *prefix, int addr) {
+  char *p = outLine();
+  p = putText(p, prefix);
+  p = disasmHex(p, addr, 4);
+  *p++ = ':';
+  endLine(p);
+}
 
-  case 0xf0:
-    printf("RP");
-    break;
-  case 0xf1:
-    printf("POP PSW");
-    break;
-  case 0xf2:
-    printTwoArgs("JP", code);
-    opbytes = 3;
-    break;
-  case 0xf3:
-    printf("DI");
-    break;
-  case 0xf4:
-    printTwoArgs("CP", code);
-    opbytes = 3;
-    break;
-  case 0xf5:
-    printf("PUSH PSW");
-    break;
-  case 0xf6:
-    printOneArg("ORI", code);
-    opbytes = 2;
-    break;
-  case 0xf7:
-    printf("RST 6");
-    break;
-  case 0xf8:
-    printf("RM");
-    break;
-  case 0xf9:
-    printf("SPHL");
-    break;
-  case 0xfa:
-    printTwoArgs("JM", code);
-    opbytes = 3;
-    break;
-  case 0xfb:
-    printf("EI");
-    break;
-  case 0xfc:
-    printTwoArgs("CM", code);
-    opbytes = 3;
-    break;
-  case 0xfd:
-    printf("NOP");
-    break;
-  case 0xfe:
-    printOneArg("CPI", code);
-    opbytes = 2;
-    break;
-  case 0xff:
-    printf("RST 7");
-    break;
+static void printListing(const Cfg *cfg, unsigned char *buffer, int fsize) {
+  int pc = 0;
+  while (pc < fsize) {
+    if (!(cfg->flags[pc] & CFG_CODE)) {
+      int end = pc;
+      while (end < fsize && !(cfg->flags[end] & CFG_CODE)) {
+        end++;
+      }
+      printData(buffer, pc, end);
+      pc = end;
+      continue;
+    }
+
+    if (cfg->flags[pc] & CFG_ROUTINE)
+      printLabel("\nsub_", pc);
+    else if (cfg->flags[pc] & CFG_LEADER)
+      printLabel("loc_", pc);
+    pc += disassembleOpcode(buffer, pc, 1);
   }
-  printf("\n");
-  return opbytes;
 }
 
 int main(int argc, char *argv[]) {
-  FILE *f = fopen(argv[1], "rb");
+  int linear = 0;
+  char *map_path = NULL;
+  int arg = 1;
+  for (; arg < argc - 1; arg++) {
+    if (strcmp(argv[arg], "-l") == 0) {
+      linear = 1;
+    } else if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc - 1) {
+      map_path = argv[++arg];
+    } else {
+      break;
+    }
+  }
+  if (arg != argc - 1) {
+    printf("usage: %s [-l] [-m blockmap] <rom>\n", argv[0]);
+    printf("  -l  decode linearly from byte 0 instead of following "
+           "control flow\n");
+    printf("  -m  write basic blocks, routines and calls to blockmap\n");
+    exit(1);
+  }
+
+  FILE *f = fopen(argv[arg], "rb");
 
   if (f == NULL) {
-    printf("error: Couldn't open file %s\n", argv[1]);
+    printf("error: Couldn't open file %s\n", argv[arg]);
     exit(1);
   }
 
   fseek(f, 0, SEEK_END);
   int fsize = ftell(f);
   fseek(f, 0, SEEK_SET);
+  if (fsize > CFG_ADDR_SPACE)
+    fsize = CFG_ADDR_SPACE;
 
-  unsigned char *buffer = malloc(fsize);
+  // two bytes of slack so operands of a truncated last instruction read 0
+  unsigned char *buffer = calloc(fsize + 2, 1);
   fread(buffer, fsize, 1, f);
   fclose(f);
 
-  int pc = 0;
+  if (linear) {
+    int pc = 0;
+    while (pc < fsize) {
+      pc += disassembleOpcode(buffer, pc, 0);
+    }
+    flushOut();
+    return 0;
+  }
 
-  while (pc < fsize) {
-    pc += handleOpcode(buffer, pc);
+  static Cfg cfg;
+  uint16_t entries[8];
+  int n_entries = cfgDefaultEntries(entries);
+  cfgAnalyse(&cfg, buffer, fsize, entries, n_entries);
+
+  if (map_path != NULL) {
+    FILE *map = fopen(map_path, "w");
+    if (map == NULL) {
+      printf("error: Couldn't open file %s\n", map_path);
+      exit(1);
+    }
+    cfgWriteBlockMap(&cfg, map);
+    fclose(map);
   }
+
+  printListing(&cfg, buffer, fsize);
+  flushOut();
+  cfgFree(&cfg);
   return 0;
 }
@@ -0,0 +1,125 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "emu.h"
+#include "fusion.h"
+#include "invaders.h"
+#include "romset.h"
+
+// Boots a ROM headless on the Invaders board with no buttons pressed and
+// writes it, together with the machine as it stands afterwards, as the C
+// file behind embedded.h. Runs at build time for EMBED_ROM.
+
+static uint8_t memory[MEMORY_SIZE];
+static uint8_t kinds[MEMORY_SIZE];
+
+static void usage(const char *prog) {
+  printf("usage: %s [-f frames] <rom|romdir> <out.c>\n", prog);
+  exit(1);
+}
+
+static void emitBytes(FILE *out, const uint8_t *bytes, size_t size) {
+  for (size_t i = 0; i < size; i += 16) {
+    fprintf(out, "   ");
+    for (size_t j = i; j < i + 16 && j < size; j++) {
+      fprintf(out, " 0x%02x,", bytes[j]);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int frames = INVADERS_BOOT_FRAMES;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:")) != -1) {
+    if (opt != 'f')
+      usage(argv[0]);
+    frames = atoi(optarg);
+  }
+  if (optind != argc - 2 || frames < 0)
+    usage(argv[0]);
+  const char *rom_path = argv[optind];
+
+  long rom_size = romLoad(rom_path, memory, ROM_SIZE);
+  if (rom_size < 0)
+    exit(1);
+  romCheck(rom_path, memory, rom_size);
+
+  CPUState cpu = {0};
+  uint8_t *registers[8] = {&cpu.b, &cpu.c, &cpu.d, &cpu.e,
+                           &cpu.h, &cpu.l, NULL,   &cpu.a};
+  InvadersBoard board;
+  cpu.memory = memory;
+  cpu.pc = PROGRAM_START;
+  invadersInit(&board, &cpu);
+  fusionPredecode(memory, rom_size, kinds);
+
+  // the same run env.c boots its machines with
+  for (int frame = 0; frame < frames; frame++) {
+    if (!invadersRunFrame(&board, &cpu, registers, kinds, NULL)) {
+      printf("error: %s escaped at pc %04x while booting\n", rom_path,
+             cpu.pc);
+      exit(1);
+    }
+  }
+
+  FILE *out = fopen(argv[optind + 1], "w");
+  if (out == NULL) {
+    printf("error: Couldn't open file %s\n", argv[optind + 1]);
+    exit(1);
+  }
+
+  fprintf(out, "// generated by 8080boot from %s, do not edit\n\n", rom_path);
+  fprintf(out, "#include \"embedded.h\"\n\n");
+  fprintf(out, "const uint32_t embeddedRomSize = %ld;\n", rom_size);
+  fprintf(out, "const uint32_t embeddedBootFrames = %d;\n\n", frames);
+  fprintf(out, "static const uint8_t memory[MEMORY_SIZE] = {\n");
+  emitBytes(out, memory, MEMORY_SIZE);
+  fprintf(out, "};\n\n");
+  fprintf(out, "static const InvadersBoard board = {\n");
+  fprintf(out, "    .port1 = 0x%02x,\n", board.port1);
+  fprintf(out, "    .port2 = 0x%02x,\n", board.port2);
+  fprintf(out, "    .shift = 0x%04x,\n", board.shift);
+  fprintf(out, "    .shift_offset = %u,\n", board.shift_offset);
+  fprintf(out, "    .sound = {0x%02x, 0x%02x},\n", board.sound[0],
+          board.sound[1]);
+  fprintf(out, "    .watchdog = 0x%02x,\n", board.watchdog);
+  fprintf(out, "    .vector = %u,\n", board.vector);
+  fprintf(out, "    .next_interrupt = %" PRIu64 "u,\n", board.next_interrupt);
+  fprintf(out, "};\n\n");
+  // pointers and page flags belong to the machine restored into
+  fprintf(out, "const Snapshot embeddedBoot = {\n");
+  fprintf(out, "    .cpu =\n        {\n");
+  fprintf(out, "            .a = 0x%02x,\n", cpu.a);
+  fprintf(out, "            .b = 0x%02x,\n", cpu.b);
+  fprintf(out, "            .c = 0x%02x,\n", cpu.c);
+  fprintf(out, "            .d = 0x%02x,\n", cpu.d);
+  fprintf(out, "            .e = 0x%02x,\n", cpu.e);
+  fprintf(out, "            .h = 0x%02x,\n", cpu.h);
+  fprintf(out, "            .l = 0x%02x,\n", cpu.l);
+  fprintf(out, "            .sp = 0x%04x,\n", cpu.sp);
+  fprintf(out, "            .pc = 0x%04x,\n", cpu.pc);
+  fprintf(out,
+          "            .cc = {.z = %u, .s = %u, .p = %u, .ac = %u, "
+          ".cy = %u},\n",
+          cpu.cc.z, cpu.cc.s, cpu.cc.p, cpu.cc.ac, cpu.cc.cy);
+  fprintf(out, "            .int_enable = %u,\n", cpu.int_enable);
+  fprintf(out, "            .cycles = %" PRIu64 "u,\n", cpu.cycles);
+  fprintf(out, "            .instructions = %" PRIu64 "u,\n",
+          cpu.instructions);
+  fprintf(out, "            .next_event = %" PRIu64 "u,\n", cpu.next_event);
+  fprintf(out, "        },\n");
+  fprintf(out, "    .memory = (uint8_t *)memory,\n");
+  fprintf(out, "    .memory_size = MEMORY_SIZE,\n");
+  fprintf(out, "    .device = (void *)&board,\n");
+  fprintf(out, "    .device_size = sizeof(InvadersBoard),\n");
+  fprintf(out, "};\n");
+  fclose(out);
+
+  printf("booted %s for %d frames, %" PRIu64 " instructions, pc %04x\n",
+         rom_path, frames, cpu.instructions, cpu.pc);
+  return 0;
+}
@@ -0,0 +1,383 @@
+// In-process coverage-guided fuzzer for the Invaders board. An input is a
+// timeline of port 1 and port 2 values, one pair per frame. The machine
+// boots once with no buttons pressed; every execution restores that
+// snapshot (copying back only the pages it dirtied), plays an input for -f
+// frames and keeps it in the corpus if it reached an address or edge bucket
+// no earlier input did. The ROM's wait-for-interrupt loops run a half frame
+// at a time (FUSE_LOOP_WAIT); everything else runs one instruction at a
+// time so coverage sees every address and edge.
+//
+// A crash (failed assert, unimplemented opcode, signal, pc running off the
+// end of memory) saves the input as crash-<hash> in the output directory
+// and stops. -r replays a saved input and reports how it ended.
+//
+// Built with EMBED_ROM, the ROM argument can be left out to fuzz the
+// embedded one from its post-boot state (embedded.h), with no boot at all.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "coverage.h"
+#include "emu.h"
+#include "fusion.h"
+#ifdef EMBEDDED_ROM
+#include "embedded.h"
+#endif
+#include "invaders.h"
+#include "opcodes.h"
+#include "romset.h"
+#include "snapshot.h"
+#include "timing.h"
+
+#define MAX_FRAMES 3600
+// bit 3 of port 1 is wired high, bit 7 is unused
+#define PORT1_MASK 0x77
+
+#ifdef EMBEDDED_ROM
+#define ROM_ARGUMENT "[rom|romdir]"
+#else
+#define ROM_ARGUMENT "rom|romdir"
+#endif
+
+static CPUState cpu;
+static InvadersBoard board;
+static uint8_t *registers[8];
+static uint8_t memory[MEMORY_SIZE];
+static uint8_t kinds[MEMORY_SIZE]; // only FUSE_LOOP_WAIT is dispatched
+
+static Snapshot boot; // the machine after booting
+
+// input being executed, saved if it crashes
+static const uint8_t *current;
+static size_t current_size;
+static const char *out_dir; // corpus inputs are only written with -o
+static int replaying;       // -r: report a crash, don't save it again
+
+static uint64_t rng = 0x9e3779b97f4a7c15;
+
+static uint32_t rnd(uint32_t n) {
+  rng ^= rng >> 12;
+  rng ^= rng << 25;
+  rng ^= rng >> 27;
+  return (uint32_t)((rng * 0x2545f4914f6cdd1dull) >> 32) % n;
+}
+
+static uint32_t hashInput(const uint8_t *input, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ input[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static void writeInput(const char *prefix, const uint8_t *input,
+                       size_t size) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s-%08x", out_dir ? out_dir : ".", prefix,
+           hashInput(input, size));
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return;
+  if (write(fd, input, size) < 0)
+    perror(path);
+  close(fd);
+}
+
+static void saveCrash(void) {
+  if (current == NULL)
+    return;
+  const uint8_t *input = current;
+  current = NULL;
+  fflush(stdout);
+  fprintf(stderr, "crash at pc %04x after %" PRIu64 " cycles\n", cpu.pc,
+          cpu.cycles);
+  if (!replaying)
+    writeInput("crash", input, current_size);
+}
+
+static void onCrash(int sig) {
+  saveCrash();
+  signal(sig, SIG_DFL);
+  raise(sig);
+}
+
+enum {
+  RUN_OK,
+  RUN_ESCAPED, // an instruction ran past the 16 KB the board decodes
+};
+
+// Plays frames of input from the boot snapshot
+static int run(const uint8_t *input, int frames, Coverage *cov) {
+  snapshotRestore(&boot, &cpu, &board);
+
+  current = input;
+  current_size = frames * 2;
+  for (int frame = 0; frame < frames; frame++) {
+    board.port1 = input[frame * 2] & PORT1_MASK;
+    board.port2 = input[frame * 2 + 1];
+    uint64_t end = (cpu.cycles / CYCLES_PER_FRAME + 1) * CYCLES_PER_FRAME;
+    while (cpu.cycles < end) {
+      uint16_t pc = cpu.pc;
+      if (!instructionFits(memory, MEMORY_SIZE, pc)) {
+        saveCrash();
+        return RUN_ESCAPED;
+      }
+      if (kinds[pc] == FUSE_LOOP_WAIT) {
+        // LDA a16 ; DCR A ; JNZ loop, or just the LDA if it didn't collapse
+        uint64_t before = cpu.instructions;
+        handleFusedOpcode(&cpu, FUSE_LOOP_WAIT, registers);
+        uint32_t passes = (cpu.instructions - before) / 3;
+        if (cov != NULL && passes > 0) {
+          coverageStep(cov, pc, pc + 3, 3);
+          coverageStep(cov, pc + 3, pc + 4, 1);
+          coverageStep(cov, pc + 4, pc, 3);
+          coverageLoop(cov, pc + 4, pc, passes - 1);
+        } else if (cov != NULL) {
+          coverageStep(cov, pc, cpu.pc, 3);
+        }
+      } else {
+        int len = opcodeLength(memory[pc]);
+        handleOpcode(&cpu, registers);
+        if (cov != NULL)
+          coverageStep(cov, pc, cpu.pc, len);
+      }
+      invadersTick(&board, &cpu);
+    }
+  }
+  current = NULL;
+  return RUN_OK;
+}
+
+// corpus holds n_corpus inputs of frames * 2 bytes back to back
+static void mutate(uint8_t *input, int frames, const uint8_t *corpus,
+                   int n_corpus) {
+  int frame = rnd(frames);
+  int len = 1 + rnd(frames - frame);
+  switch (rnd(5)) {
+  case 0: // flip one bit in one frame
+    input[frame * 2 + rnd(2)] ^= 1 << rnd(8);
+    break;
+  case 1: { // hold or release a button over a run of frames
+    int port = rnd(2);
+    uint8_t bit = 1 << rnd(8);
+    uint8_t on = rnd(2) ? bit : 0;
+    for (int i = frame; i < frame + len; i++) {
+      input[i * 2 + port] = (input[i * 2 + port] & ~bit) | on;
+    }
+    break;
+  }
+  case 2: // random values for one frame
+    input[frame * 2] = rnd(256);
+    input[frame * 2 + 1] = rnd(256);
+    break;
+  case 3: { // splice in frames from another input
+    const uint8_t *other = &corpus[rnd(n_corpus) * frames * 2];
+    memcpy(&input[frame * 2], &other[frame * 2], len * 2);
+    break;
+  }
+  default: // shift the rest of the timeline by a frame either way
+    if (frame + 1 >= frames)
+      break;
+    if (rnd(2))
+      memmove(&input[(frame + 1) * 2], &input[frame * 2],
+              (frames - frame - 1) * 2);
+    else
+      memmove(&input[frame * 2], &input[(frame + 1) * 2],
+              (frames - frame - 1) * 2);
+    break;
+  }
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-f frames] [-b boot frames] [-n execs] [-t seconds] "
+          "[-s seed] [-o dir] [-r input] %s\n",
+          prog, ROM_ARGUMENT);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  int frames = 30;
+  int boot_frames = -1; // default: a full boot, none on top of embedded.h
+  uint64_t max_execs = UINT64_MAX;
+  double seconds = 0;
+  const char *replay = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:b:n:t:s:o:r:")) != -1) {
+    switch (opt) {
+    case 'f':
+      frames = atoi(optarg);
+      break;
+    case 'b':
+      boot_frames = atoi(optarg);
+      break;
+    case 'n':
+      max_execs = strtoull(optarg, NULL, 0);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    case 's':
+      rng = strtoull(optarg, NULL, 0) | 1;
+      break;
+    case 'o':
+      out_dir = optarg;
+      break;
+    case 'r':
+      replay = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind < argc - 1 || frames < 1 || frames > MAX_FRAMES ||
+      boot_frames < -1)
+    usage(argv[0]);
+  const char *rom_path = optind < argc ? argv[optind] : NULL;
+#ifndef EMBEDDED_ROM
+  if (rom_path == NULL)
+    usage(argv[0]);
+#endif
+
+  static uint8_t input[MAX_FRAMES * 2];
+  if (replay != NULL) {
+    FILE *in = fopen(replay, "rb");
+    if (in == NULL) {
+      fprintf(stderr, "error: Couldn't open file %s\n", replay);
+      return 1;
+    }
+    frames = fread(input, 1, sizeof(input), in) / 2;
+    fclose(in);
+    if (frames == 0) {
+      fprintf(stderr, "error: %s is empty\n", replay);
+      return 1;
+    }
+  }
+
+  registers[0] = &cpu.b;
+  registers[1] = &cpu.c;
+  registers[2] = &cpu.d;
+  registers[3] = &cpu.e;
+  registers[4] = &cpu.h;
+  registers[5] = &cpu.l;
+  registers[6] = NULL; // mem reg
+  registers[7] = &cpu.a;
+  cpu.memory = memory;
+  cpu.pc = PROGRAM_START;
+  invadersInit(&board, &cpu);
+
+  long rom_size;
+  int start_frames = 0; // booted before this run
+#ifdef EMBEDDED_ROM
+  if (rom_path == NULL) {
+    // already booted; -b runs frames on top
+    embeddedStart(&cpu, &board);
+    rom_size = embeddedRomSize;
+    start_frames = embeddedBootFrames;
+    if (boot_frames < 0)
+      boot_frames = 0;
+  } else
+#endif
+  {
+    rom_size = romLoad(rom_path, memory, MEMORY_SIZE);
+    if (rom_size < 0)
+      return 1;
+    if (boot_frames < 0)
+      boot_frames = INVADERS_BOOT_FRAMES;
+  }
+  fusionPredecode(memory, rom_size < ROM_SIZE ? rom_size : ROM_SIZE, kinds);
+
+  signal(SIGABRT, onCrash);
+  signal(SIGSEGV, onCrash);
+  signal(SIGBUS, onCrash);
+  signal(SIGFPE, onCrash);
+  signal(SIGILL, onCrash);
+  atexit(saveCrash); // unimplementedOpcodeError exits
+
+  // boot with no input: an all-zero timeline is the boot itself
+  snapshotTake(&boot, &cpu, MEMORY_SIZE, &board, sizeof(board));
+  static uint8_t idle[MAX_FRAMES * 2];
+  for (int done = 0; done < boot_frames; done += MAX_FRAMES) {
+    int n = boot_frames - done < MAX_FRAMES ? boot_frames - done : MAX_FRAMES;
+    if (run(idle, n, NULL) != RUN_OK)
+      return 1;
+    snapshotTake(&boot, &cpu, MEMORY_SIZE, &board, sizeof(board));
+  }
+  printf("booted %ld byte rom for %d frames, %" PRIu64 " instructions\n",
+         rom_size, start_frames + boot_frames,
+         boot.cpu.instructions);
+
+  static Coverage total, cov;
+  if (replay != NULL) {
+    replaying = 1;
+    int result = run(input, frames, &cov);
+    coverageMerge(&total, &cov);
+    int pcs, edges;
+    coverageCount(&total, &pcs, &edges);
+    printf("%d frames: %s at pc %04x, %d pcs, %d edges\n", frames,
+           result == RUN_OK ? "ok" : "escaped", cpu.pc, pcs, edges);
+    return result != RUN_OK;
+  }
+
+  size_t input_size = frames * 2;
+  int corpus_cap = 64;
+  uint8_t *corpus = calloc(corpus_cap, input_size);
+  int n_corpus = 1;
+  run(corpus, frames, &cov);
+  coverageMerge(&total, &cov);
+
+  uint64_t start = nowNs();
+  uint64_t last_report = start;
+  uint64_t execs = 0;
+  while (execs < max_execs) {
+    memcpy(input, &corpus[rnd(n_corpus) * input_size], input_size);
+    int stack = 1 << rnd(3);
+    for (int i = 0; i < stack; i++) {
+      mutate(input, frames, corpus, n_corpus);
+    }
+
+    coverageClear(&cov);
+    if (run(input, frames, &cov) != RUN_OK)
+      return 1;
+    execs++;
+    if (coverageMerge(&total, &cov) > 0) {
+      if (n_corpus == corpus_cap) {
+        corpus_cap *= 2;
+        corpus = realloc(corpus, corpus_cap * input_size);
+      }
+      memcpy(&corpus[n_corpus++ * input_size], input, input_size);
+      if (out_dir != NULL)
+        writeInput("input", input, input_size);
+    }
+
+    if ((execs & 63) == 0) {
+      uint64_t now = nowNs();
+      if (now - last_report >= 1000000000 || execs >= max_execs) {
+        int pcs, edges;
+        coverageCount(&total, &pcs, &edges);
+        printf("#%" PRIu64 " %.0f exec/s, corpus %d, %d pcs, %d edges\n",
+               execs, execs * 1e9 / (now - start), n_corpus, pcs, edges);
+        fflush(stdout);
+        last_report = now;
+      }
+      if (seconds > 0 && now - start >= seconds * 1e9)
+        break;
+    }
+  }
+
+  uint64_t elapsed = nowNs() - start;
+  int pcs, edges;
+  coverageCount(&total, &pcs, &edges);
+  printf("done: %" PRIu64 " execs, %.0f exec/s, corpus %d, %d pcs, "
+         "%d edges\n",
+         execs, elapsed ? execs * 1e9 / elapsed : 0.0, n_corpus, pcs, edges);
+  free(corpus);
+  snapshotFree(&boot);
+  return 0;
+}
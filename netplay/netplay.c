@@ -0,0 +1,248 @@
+// Two rollback peers (rollback.h) playing a two-player game against each
+// other over a loopback link (loopback.h) with latency, jitter and packet
+// loss, in simulated time. Both players' inputs are scripted: coins, the
+// two-player start, then buttons held for a few frames at a time. At the
+// end each peer, and a reference machine that was always given both
+// inputs, must have arrived at the same state; the report shows what the
+// rollbacks cost. So that agreeing proves something, the inputs must also
+// have started a game, and a reference given another seed's inputs must
+// have ended up elsewhere.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emu.h"
+#include "fusion.h"
+#include "invaders.h"
+#include "loopback.h"
+#include "rollback.h"
+#include "romset.h"
+#include "snapshot.h"
+#include "timing.h"
+#ifdef EMBEDDED_ROM
+#include "embedded.h"
+#endif
+
+#ifdef EMBEDDED_ROM
+#define ROM_ARGUMENT "[rom|romdir]"
+#else
+#define ROM_ARGUMENT "rom|romdir"
+#endif
+
+#define FRAME_US 16667
+// Held buttons change at most this often
+#define HOLD_FRAMES 6
+
+static uint64_t seed = 1;
+
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  return x ^ (x >> 33);
+}
+
+// Buttons of player (0 or 1) in frame, the same however often asked
+static uint8_t inputFor(int player, uint32_t frame) {
+  if (frame < 60)
+    return 0;
+  if (frame < 65)
+    return player == 0 ? INVADERS_COIN : 0;
+  if (frame < 75)
+    return 0;
+  if (frame < 80)
+    return player == 1 ? INVADERS_COIN : 0;
+  if (frame < 90)
+    return 0;
+  if (frame < 95)
+    return player == 1 ? INVADERS_P1_START : 0; // two players
+  static const uint8_t held[] = {
+      0,
+      INVADERS_P1_SHOT,
+      INVADERS_P1_LEFT,
+      INVADERS_P1_RIGHT,
+      INVADERS_P1_LEFT | INVADERS_P1_SHOT,
+      INVADERS_P1_RIGHT | INVADERS_P1_SHOT,
+  };
+  uint64_t r = mix(seed ^ ((uint64_t)player << 32) ^ (frame / HOLD_FRAMES));
+  return held[r % sizeof(held)];
+}
+
+// A packet holding the other player's input for one frame, so the
+// reference never predicts
+static void feed(Rollback *rb, uint32_t frame, uint8_t input) {
+  uint8_t packet[10] = {frame, frame >> 8, frame >> 16, frame >> 24,
+                        0,     0,          0,           0,
+                        1,     input};
+  rollbackReceive(rb, packet, sizeof(packet));
+}
+
+// Runs rb as the reference for seed, both inputs known in advance.
+// Returns whether a game got under way.
+static int runReference(Rollback *rb, uint32_t frames) {
+  int played = 0;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    feed(rb, frame, inputFor(1, frame));
+    rollbackAdvance(rb, inputFor(0, frame));
+    played |= rb->memory[INVADERS_GAME_MODE] == 1;
+  }
+  return played;
+}
+
+// The ROM run with no input for the boot, as both peers start
+static void boot(const char *rom_path, Snapshot *start) {
+  static uint8_t memory[MEMORY_SIZE];
+  static uint8_t kinds[MEMORY_SIZE];
+  long rom_size = romLoad(rom_path, memory, MEMORY_SIZE);
+  if (rom_size < 0)
+    exit(1);
+  CPUState cpu = {0};
+  uint8_t *registers[8] = {&cpu.b, &cpu.c, &cpu.d, &cpu.e,
+                           &cpu.h, &cpu.l, NULL,   &cpu.a};
+  InvadersBoard board;
+  cpu.memory = memory;
+  cpu.pc = PROGRAM_START;
+  invadersInit(&board, &cpu);
+  fusionPredecode(memory, rom_size < ROM_SIZE ? rom_size : ROM_SIZE, kinds);
+  for (int frame = 0; frame < INVADERS_BOOT_FRAMES; frame++) {
+    if (!invadersRunFrame(&board, &cpu, registers, kinds, NULL))
+      break;
+  }
+  snapshotTake(start, &cpu, MEMORY_SIZE, &board, sizeof(board));
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-f frames] [-l latency ms] [-j jitter ms] [-p loss %%] "
+          "[-s seed] %s\n",
+          prog, ROM_ARGUMENT);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t frames = 3600;
+  double latency_ms = 50;
+  double jitter_ms = 10;
+  double loss = 5;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:l:j:p:s:")) != -1) {
+    switch (opt) {
+    case 'f':
+      frames = strtoul(optarg, NULL, 0);
+      break;
+    case 'l':
+      latency_ms = atof(optarg);
+      break;
+    case 'j':
+      jitter_ms = atof(optarg);
+      break;
+    case 'p':
+      loss = atof(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind < argc - 1 || frames == 0 || latency_ms < 0 || jitter_ms < 0 ||
+      loss < 0 || loss >= 100)
+    usage(argv[0]);
+
+  static Snapshot booted;
+  const Snapshot *start = &booted;
+  if (optind < argc) {
+    boot(argv[optind], &booted);
+  } else {
+#ifdef EMBEDDED_ROM
+    start = &embeddedBoot;
+#else
+    usage(argv[0]);
+#endif
+  }
+
+  static Rollback peers[2], reference, other;
+  if (!rollbackInit(&peers[0], start, 0) ||
+      !rollbackInit(&peers[1], start, 1) ||
+      !rollbackInit(&reference, start, 0) ||
+      !rollbackInit(&other, start, 0)) {
+    fprintf(stderr, "error: Out of memory\n");
+    return 1;
+  }
+  static Loopback link;
+  loopbackInit(&link, latency_ms * 1000, jitter_ms * 1000, loss / 100, seed);
+
+  uint64_t wall = nowNs();
+  uint8_t packet[ROLLBACK_PACKET_MAX];
+  // give up on a link that never gets anything through
+  uint64_t max_ticks = (uint64_t)frames * 100 + 100000;
+  uint64_t tick = 0;
+  for (; tick < max_ticks; tick++) {
+    uint64_t now_us = tick * FRAME_US;
+    int finished = 1;
+    for (int p = 0; p < 2; p++) {
+      Rollback *rb = &peers[p];
+      int size;
+      while ((size = loopbackReceive(&link, p, packet, now_us)) > 0) {
+        rollbackReceive(rb, packet, size);
+      }
+      if (rb->frame < frames)
+        rollbackAdvance(rb, inputFor(p, rb->frame));
+      // every tick, stalled or not, so acks and lost inputs get through
+      loopbackSend(&link, p, packet, rollbackPacket(rb, packet), now_us);
+      finished &= rb->frame == frames && rb->remote_known == frames;
+    }
+    if (finished)
+      break;
+  }
+  wall = nowNs() - wall;
+  if (tick == max_ticks) {
+    fprintf(stderr, "error: peers still not in step after %" PRIu64
+                    " ticks\n", tick);
+    return 1;
+  }
+  rollbackSettle(&peers[0]);
+  rollbackSettle(&peers[1]);
+
+  int played = runReference(&reference, frames);
+  seed++;
+  runReference(&other, frames);
+  seed--;
+
+  printf("%u frames in %.1f simulated s (%.0f ms, +-%.0f ms, %.0f%% loss), "
+         "%.2f s wall\n",
+         frames, tick * FRAME_US / 1e6, latency_ms, jitter_ms, loss,
+         wall / 1e9);
+  printf("link: %" PRIu64 " packets sent, %" PRIu64 " lost, %" PRIu64
+         " delivered\n",
+         link.sent, link.lost, link.delivered);
+  for (int p = 0; p < 2; p++) {
+    printf("player %d ", p + 1);
+    rollbackReport(stdout, &peers[p]);
+  }
+
+  uint32_t sums[3] = {rollbackChecksum(&peers[0]),
+                      rollbackChecksum(&peers[1]),
+                      rollbackChecksum(&reference)};
+  int synced = sums[0] == sums[2] && sums[1] == sums[2];
+  printf("checksums %08x %08x, reference %08x: %s\n", sums[0], sums[1],
+         sums[2], synced ? "in sync" : "DESYNC");
+  // a machine the inputs never reach agrees with itself for any seed
+  int steered = played && rollbackChecksum(&other) != sums[2];
+  if (!played)
+    fprintf(stderr, "error: No game started in %u frames\n", frames);
+  else if (!steered)
+    fprintf(stderr, "error: Seeds %" PRIu64 " and %" PRIu64
+                    " ended in the same state\n", seed, seed + 1);
+  for (int p = 0; p < 2; p++) {
+    rollbackFree(&peers[p]);
+  }
+  rollbackFree(&reference);
+  rollbackFree(&other);
+  return !synced || !steered;
+}
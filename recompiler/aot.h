@@ -0,0 +1,26 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+
+#include "emu.h"
+
+// Implemented by the C file 8080aot generates from a ROM. Runs compiled code
+// from state->pc up to the next branch, or until a device event is due, and
+// returns 1; or interprets a single instruction and returns 0 when pc isn't
+// a compiled instruction (computed jumps, code the recompiler never
+// reached, RAM). Either way the caller then raises any interrupt due, as
+// the interpreter's run loop does after every instruction.
+int aotStep(CPUState *state, uint8_t *registers[]);
+
+// The ROM bytes aotStep was compiled from, for checking that the ROM it runs
+// with is the same
+extern const uint32_t aotRomSize;
+extern const uint32_t aotRomCrc;
+
+// Between two compiled instructions: the next device event has come
+static inline int aotEventDue(const CPUState *state) {
+  return state->next_event && state->cycles >= state->next_event;
+}
+
+#endif
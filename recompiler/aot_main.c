@@ -0,0 +1,81 @@
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "aot.h"
+#include "emu.h"
+#include "invaders.h"
+#include "perf.h"
+#include "romset.h"
+
+// The game never ends on its own: Ctrl-C stops it, so --perf still reports
+static volatile sig_atomic_t interrupted;
+
+static void onInterrupt(int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+// Runs a ROM on the Invaders board through the code 8080aot compiled for
+// it. The ROM is still loaded into memory: data reads and the interpreter
+// fallback need it.
+int main(int argc, char *argv[]) {
+  int perf_mode = argc == 3 && strcmp(argv[1], "--perf") == 0;
+  if (argc != 2 + perf_mode) {
+    fprintf(stderr, "usage: %s [--perf] rom|romdir\n", argv[0]);
+    exit(1);
+  }
+
+  CPUState cpu_state = {0};
+  cpu_state.memory = (uint8_t *)calloc(MEMORY_SIZE, 1);
+  cpu_state.pc = PROGRAM_START;
+
+  uint8_t *registers[8];
+  registers[0] = &cpu_state.b;
+  registers[1] = &cpu_state.c;
+  registers[2] = &cpu_state.d;
+  registers[3] = &cpu_state.e;
+  registers[4] = &cpu_state.h;
+  registers[5] = &cpu_state.l;
+  registers[6] = NULL; // mem reg
+  registers[7] = &cpu_state.a;
+
+  static InvadersBoard board;
+  invadersInit(&board, &cpu_state);
+
+  long fsize = romLoad(argv[argc - 1], cpu_state.memory, MEMORY_SIZE);
+  if (fsize < 0)
+    exit(1);
+  // compiled code is only right for the ROM it was compiled from
+  if (fsize < (long)aotRomSize ||
+      crc32(cpu_state.memory, aotRomSize) != aotRomCrc) {
+    fprintf(stderr,
+            "error: %s isn't the ROM this was compiled from (crc %08x)\n",
+            argv[argc - 1], aotRomCrc);
+    exit(1);
+  }
+
+  PerfCounters perf;
+  if (perf_mode) {
+    if (perfOpen(&perf) == 0)
+      fprintf(stderr, "perf: no hardware counters, timing only\n");
+    perfStart(&perf);
+  }
+
+  signal(SIGINT, onInterrupt);
+  uint64_t dispatches = 0;
+  while (cpu_state.pc < fsize && !interrupted) {
+    aotStep(&cpu_state, registers);
+    dispatches++;
+    invadersTick(&board, &cpu_state);
+  }
+
+  if (perf_mode) {
+    perfStop(&perf);
+    perfReport(stdout, "aot", &perf, cpu_state.instructions, dispatches);
+    perfClose(&perf);
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+#include "emu.h"
+#include "opcodes.h"
+#include "romset.h"
+
+// Static recompiler: walks the control flow graph of a ROM from the reset
+// and RST vectors and writes a C file in which every reached instruction is
+// a case of aotStep, falling through to the next until a branch. Each one
+// is an execOpcode call with its bytes as constants; the generated file has
+// it inlined everywhere (AOT_INLINE, ops.h), so the opcode switch folds to
+// the helper for that one opcode. Between instructions the code returns if
+// a device event is due, so the caller raises interrupts at the same
+// instruction boundaries the interpreter does.
+
+#define ADDR_SPACE 0x10000
+#define MAX_ENTRIES 4096
+
+static uint8_t rom[ADDR_SPACE];
+static int rom_size;
+
+static uint8_t is_code[ADDR_SPACE];
+
+// Instructions after which control doesn't simply fall through to the next
+// one in the interpreter. HLT is included because the interpreter leaves pc
+// on it until an interrupt.
+static int endsBlock(uint8_t op) { return isControlFlow(op); }
+
+static void walk(const uint16_t *entries, int n_entries) {
+  static Cfg cfg;
+  cfgAnalyse(&cfg, rom, rom_size, entries, n_entries);
+  for (int addr = 0; addr < rom_size; addr++) {
+    is_code[addr] = (cfg.flags[addr] & CFG_CODE) != 0;
+  }
+  cfgFree(&cfg);
+}
+
+// One case per instruction, so code returned to or resumed after an
+// interrupt mid-block is compiled too. Returns 1 if the instruction ends a
+// straight-line run.
+static int emitInstruction(FILE *out, uint32_t pc) {
+  uint8_t op = rom[pc];
+  int len = opcodeLength(op);
+  fprintf(out, "  case 0x%04x:\n", pc);
+  fprintf(out, "    execOpcode(state, registers, (const uint8_t[]){");
+  for (int i = 0; i < 3; i++) {
+    fprintf(out, "%s0x%02x", i ? ", " : "", i < len ? rom[pc + i] : 0);
+  }
+  fprintf(out, "});\n");
+
+  uint32_t next = pc + len;
+  if (endsBlock(op) || next >= (uint32_t)rom_size || !is_code[next]) {
+    fprintf(out, "    return 1;\n");
+    return 1;
+  }
+  fprintf(out, "    if (aotEventDue(state))\n      return 1;\n");
+  fprintf(out, "    /* fall through */\n");
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static uint16_t entries[MAX_ENTRIES];
+  int n_entries = cfgDefaultEntries(entries);
+
+  // -m <block map> adds the blocks the disassembler found as extra entries
+  if (argc == 5 && strcmp(argv[1], "-m") == 0) {
+    FILE *map = fopen(argv[2], "r");
+    if (map == NULL) {
+      printf("error: Couldn't open file %s\n", argv[2]);
+      exit(1);
+    }
+    int n = cfgReadBlockMap(map, &entries[n_entries], MAX_ENTRIES - n_entries);
+    fclose(map);
+    if (n < 0) {
+      printf("error: Malformed block map %s\n", argv[2]);
+      exit(1);
+    }
+    n_entries += n;
+    argc -= 2;
+    argv += 2;
+  }
+
+  if (argc != 3) {
+    printf("usage: %s [-m blockmap] <rom|romdir> <out.c>\n", argv[0]);
+    exit(1);
+  }
+
+  long size = romLoad(argv[1], rom, MEMORY_SIZE);
+  if (size < 0)
+    exit(1);
+  rom_size = size;
+  if (rom_size > ROM_SIZE)
+    rom_size = ROM_SIZE;
+
+  walk(entries, n_entries);
+
+  FILE *out = fopen(argv[2], "w");
+  if (out == NULL) {
+    printf("error: Couldn't open file %s\n", argv[2]);
+    exit(1);
+  }
+
+  int runs = 0;
+  int instructions = 0;
+  fprintf(out, "// generated by 8080aot from %s, do not edit\n\n", argv[1]);
+  fprintf(out, "#define AOT_INLINE\n\n");
+  fprintf(out, "#include \"aot.h\"\n#include \"emu.h\"\n"
+               "#include \"ops.h\"\n\n");
+  fprintf(out, "const uint32_t aotRomSize = %d;\n", rom_size);
+  fprintf(out, "const uint32_t aotRomCrc = 0x%08x;\n\n",
+          crc32(rom, rom_size));
+  fprintf(out, "int aotStep(CPUState *state, uint8_t *registers[]) {\n");
+  fprintf(out, "  switch (state->pc) {\n");
+  for (uint32_t addr = 0; addr < (uint32_t)rom_size; addr++) {
+    if (is_code[addr]) {
+      runs += emitInstruction(out, addr);
+      instructions++;
+    }
+  }
+  fprintf(out, "  default:\n");
+  fprintf(out, "    handleOpcode(state, registers);\n");
+  fprintf(out, "    return 0;\n");
+  fprintf(out, "  }\n}\n");
+  fclose(out);
+
+  printf("%d straight-line runs, %d instructions reached\n", runs,
+         instructions);
+  return 0;
+}
@@ -9,6 +9,6 @@ cmake -S "$SOURCE_DIR" -B "$BUILD_DIR"
 
 cmake --build "$BUILD_DIR"
 
-"$BUILD_DIR"/8080emu ./invaders_rom/invaders
+"$BUILD_DIR"/8080emu ./invaders_rom
 
 
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+#define HUGE_PAGE (2 << 20)
+
+static size_t roundUp(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+// One sealed memfd holding the ROM, padded to whole pages
+static int romFile(const uint8_t *rom, size_t rom_size, size_t mapped) {
+  int fd = memfd_create("8080rom", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0)
+    return -1;
+  if (ftruncate(fd, mapped) != 0 ||
+      pwrite(fd, rom, rom_size, 0) != (ssize_t)rom_size ||
+      fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Explicit hugepages if the system has a pool, transparent ones otherwise
+static uint8_t *hugeRegion(size_t len) {
+  void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED)
+    return p;
+  p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+           -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  madvise(p, len, MADV_HUGEPAGE);
+  return p;
+}
+
+int arenaInit(Arena *arena, int capacity, size_t state_size,
+              const uint8_t *rom, size_t rom_size) {
+  memset(arena, 0, sizeof(Arena));
+  arena->rom_fd = -1;
+  if (rom_size > ROM_SIZE || capacity < 1)
+    return 0;
+
+  arena->capacity = capacity;
+  arena->state_size = roundUp(state_size, 64);
+  arena->rom_size = roundUp(rom_size, sysconf(_SC_PAGESIZE));
+  if (arena->rom_size > 0) {
+    arena->rom_fd = romFile(rom, rom_size, arena->rom_size);
+    if (arena->rom_fd < 0)
+      return 0;
+  }
+
+  arena->states_len = roundUp(capacity * arena->state_size, HUGE_PAGE);
+  arena->states = hugeRegion(arena->states_len);
+  void *spaces = mmap(NULL, (size_t)capacity * ARENA_SPACE,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  arena->spaces = spaces == MAP_FAILED ? NULL : spaces;
+  arena->free_list = malloc(capacity * sizeof(int));
+  if (arena->states == NULL || arena->spaces == NULL ||
+      arena->free_list == NULL) {
+    arenaDestroy(arena);
+    return 0;
+  }
+  return 1;
+}
+
+void arenaDestroy(Arena *arena) {
+  if (arena->states != NULL)
+    munmap(arena->states, arena->states_len);
+  if (arena->spaces != NULL)
+    munmap(arena->spaces, (size_t)arena->capacity * ARENA_SPACE);
+  if (arena->rom_fd >= 0)
+    close(arena->rom_fd);
+  free(arena->free_list);
+  memset(arena, 0, sizeof(Arena));
+  arena->rom_fd = -1;
+}
+
+void *arenaAlloc(Arena *arena, uint8_t **memory) {
+  int i;
+  if (arena->n_free > 0) {
+    i = arena->free_list[--arena->n_free];
+  } else if (arena->fresh < arena->capacity) {
+    // first use: put the shared ROM over the start of the address space
+    i = arena->fresh;
+    uint8_t *space = arena->spaces + (size_t)i * ARENA_SPACE;
+    if (arena->rom_size > 0 &&
+        mmap(space, arena->rom_size, PROT_READ, MAP_SHARED | MAP_FIXED,
+             arena->rom_fd, 0) == MAP_FAILED)
+      return NULL;
+    arena->fresh++;
+  } else {
+    return NULL;
+  }
+
+  uint8_t *state = arena->states + i * arena->state_size;
+  memset(state, 0, arena->state_size);
+  *memory = arena->spaces + (size_t)i * ARENA_SPACE;
+  return state;
+}
+
+void arenaFree(Arena *arena, void *state) {
+  int i = ((uint8_t *)state - arena->states) / arena->state_size;
+  uint8_t *space = arena->spaces + (size_t)i * ARENA_SPACE;
+  madvise(space + arena->rom_size, ARENA_SPACE - arena->rom_size,
+          MADV_DONTNEED);
+  arena->free_list[arena->n_free++] = i;
+}
+
+void arenaWire(const Arena *arena, CPUState *state, uint8_t *memory) {
+  state->memory = memory;
+  for (size_t page = 0; page < arena->rom_size >> 8; page++) {
+    state->page_flags[page] |= PAGE_ROM;
+  }
+}
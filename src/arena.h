@@ -0,0 +1,60 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Many machines running one ROM. Instance state blocks (a fixed-size
+// struct of the caller's, CPUState and board included) are carved from one
+// hugepage-backed slab. Every instance also gets its own 16 KB address
+// space in one big reservation, with the ROM pages mapped from a single
+// sealed memfd: all instances share the same physical ROM, read-only
+// through the page table. The rest of an address space is private and only
+// costs memory once stored to, so an instance weighs about its RAM plus its
+// state block.
+//
+// Stores to ROM would fault, so arenaWire flags the ROM pages PAGE_ROM and
+// memWrite drops stores there, as the board does.
+//
+// Address spaces sit back to back with no guard between them. Data
+// accesses are masked into MEMORY_SIZE, but an instruction fetched near the
+// top would read its operands from the next instance (or past the end of
+// the reservation), so run loops stop before one that doesn't fit
+// (instructionFits in opcodes.h).
+//
+// Allocation and free are free-list pushes and pops. A freed address space
+// is handed back to the kernel with one madvise and reads as zeros when
+// reused.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emu.h"
+
+// Bytes per address space, the next one starts right after
+#define ARENA_SPACE MEMORY_SIZE
+
+typedef struct {
+  int capacity;
+  size_t state_size; // rounded up to a cache line
+  size_t rom_size;   // rounded up to a page, mapped at address 0
+  int rom_fd;
+  uint8_t *states;   // capacity * state_size
+  size_t states_len;
+  uint8_t *spaces;   // capacity * ARENA_SPACE
+  int *free_list;    // instances returned by arenaFree
+  int n_free;
+  int fresh; // instances below this have had their ROM mapped
+} Arena;
+
+// Returns 0 if the ROM is larger than ROM_SIZE or the mappings fail
+int arenaInit(Arena *arena, int capacity, size_t state_size,
+              const uint8_t *rom, size_t rom_size);
+void arenaDestroy(Arena *arena);
+
+// A zeroed state block, NULL when all capacity is in use. *memory is the
+// instance's address space: the ROM, zeros above it.
+void *arenaAlloc(Arena *arena, uint8_t **memory);
+void arenaFree(Arena *arena, void *state);
+
+// Points state at memory (from arenaAlloc) and flags the shared ROM pages
+void arenaWire(const Arena *arena, CPUState *state, uint8_t *memory);
+
+#endif
@@ -0,0 +1,167 @@
+#ifdef CALLSTACK
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "callstack.h"
+
+#define MAX_DEPTH 256
+#define MAX_NODES 0x10000
+
+// A node per distinct call path, children linked from their parent
+typedef struct {
+  uint16_t routine;
+  int parent;
+  int first_child;
+  int next_sibling;
+  uint64_t self_cycles;
+  uint64_t calls;
+} PathNode;
+
+typedef struct {
+  uint16_t sp; // slot of the return address
+  int node;
+} Frame;
+
+static PathNode nodes[MAX_NODES];
+static int n_nodes;
+static Frame frames[MAX_DEPTH];
+static int depth;
+static uint64_t last_cycles;
+static uint64_t dropped_calls; // deeper than MAX_DEPTH or out of nodes
+
+static inline int current(void) { return depth ? frames[depth - 1].node : 0; }
+
+// Cycles since the last event belong to the path that was running
+static inline void charge(uint64_t cycles) {
+  nodes[current()].self_cycles += cycles - last_cycles;
+  last_cycles = cycles;
+}
+
+static int child(int parent, uint16_t routine) {
+  for (int i = nodes[parent].first_child; i; i = nodes[i].next_sibling) {
+    if (nodes[i].routine == routine)
+      return i;
+  }
+  if (n_nodes == MAX_NODES)
+    return -1;
+
+  int i = n_nodes++;
+  nodes[i] = (PathNode){routine, parent, 0, nodes[parent].first_child, 0, 0};
+  nodes[parent].first_child = i;
+  return i;
+}
+
+void callstackInit(uint16_t entry, uint64_t cycles) {
+  memset(nodes, 0, sizeof(nodes));
+  nodes[0].routine = entry;
+  nodes[0].parent = -1;
+  n_nodes = 1;
+  depth = 0;
+  last_cycles = cycles;
+  dropped_calls = 0;
+}
+
+void callstackCall(uint16_t target, uint16_t sp, uint64_t cycles) {
+  charge(cycles);
+  int node = depth < MAX_DEPTH ? child(current(), target) : -1;
+  if (node < 0) {
+    dropped_calls++;
+    return;
+  }
+  nodes[node].calls++;
+  frames[depth++] = (Frame){sp, node};
+}
+
+void callstackReturn(uint16_t sp, uint64_t cycles) {
+  charge(cycles);
+  int frame = depth - 1;
+  while (frame >= 0 && frames[frame].sp < sp) {
+    frame--;
+  }
+  // no frame owns this slot: RET used as a jump
+  if (frame < 0 || frames[frame].sp != sp)
+    return;
+  depth = frame;
+}
+
+typedef struct {
+  uint16_t routine;
+  uint64_t inclusive;
+  uint64_t exclusive;
+  uint64_t calls;
+} RoutineTotals;
+
+static int compareInclusive(const void *a, const void *b) {
+  uint64_t x = ((const RoutineTotals *)a)->inclusive;
+  uint64_t y = ((const RoutineTotals *)b)->inclusive;
+  return (x < y) - (x > y);
+}
+
+void callstackReport(FILE *out, uint64_t cycles) {
+  static RoutineTotals totals[0x10000];
+  static uint8_t on_path[0x10000];
+  charge(cycles);
+
+  memset(totals, 0, sizeof(totals));
+  uint64_t total = 0;
+  for (int i = 0; i < n_nodes; i++) {
+    PathNode *node = &nodes[i];
+    total += node->self_cycles;
+    totals[node->routine].exclusive += node->self_cycles;
+    totals[node->routine].calls += node->calls;
+
+    // recursion must not count a routine's cycles twice
+    for (int p = i; p >= 0; p = nodes[p].parent) {
+      if (on_path[nodes[p].routine])
+        continue;
+      on_path[nodes[p].routine] = 1;
+      totals[nodes[p].routine].inclusive += node->self_cycles;
+    }
+    for (int p = i; p >= 0; p = nodes[p].parent) {
+      on_path[nodes[p].routine] = 0;
+    }
+  }
+
+  int n = 0;
+  for (uint32_t routine = 0; routine < 0x10000; routine++) {
+    if (totals[routine].inclusive == 0 && totals[routine].calls == 0)
+      continue;
+    totals[routine].routine = routine;
+    totals[n++] = totals[routine];
+  }
+  qsort(totals, n, sizeof(RoutineTotals), compareInclusive);
+
+  fprintf(out, "call stack: %" PRIu64 " cycles, %d paths, %" PRIu64
+               " calls not tracked\n\n", total, n_nodes, dropped_calls);
+  fprintf(out, "  routine        calls     inclusive      %%     exclusive"
+               "      %%\n");
+  for (int i = 0; i < n; i++) {
+    RoutineTotals *t = &totals[i];
+    fprintf(out, "  sub_%04x %12" PRIu64 " %13" PRIu64 " %6.2f %13" PRIu64
+                 " %6.2f\n", t->routine, t->calls, t->inclusive,
+            total ? 100.0 * t->inclusive / total : 0.0, t->exclusive,
+            total ? 100.0 * t->exclusive / total : 0.0);
+  }
+}
+
+static void writePath(FILE *out, int node) {
+  if (nodes[node].parent >= 0) {
+    writePath(out, nodes[node].parent);
+    fputc(';', out);
+  }
+  fprintf(out, "sub_%04x", nodes[node].routine);
+}
+
+void callstackWriteFolded(FILE *out, uint64_t cycles) {
+  charge(cycles);
+  for (int i = 0; i < n_nodes; i++) {
+    if (nodes[i].self_cycles == 0)
+      continue;
+    writePath(out, i);
+    fprintf(out, " %" PRIu64 "\n", nodes[i].self_cycles);
+  }
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef CALLSTACK_H
+#define CALLSTACK_H
+
+// Shadow call stack profiler, compiled in with -DCALLSTACK (the CALLSTACK
+// CMake option). i8080_call, i8080_rst and i8080_ret report to it; cycles
+// between those events are charged to the call path that was current.
+//
+// Frames are keyed by the stack slot holding their return address, not by
+// the address itself, so stack tricks stay consistent:
+// - XTHL or a routine rewriting its return address still returns through
+//   the same slot and pops the right frame
+// - POP-then-JMP leaves a stale frame that the next RET through a slot
+//   further up the stack unwinds along with its own
+// - PUSH then RET (a computed jump) returns through a slot below every
+//   frame and pops nothing
+
+#ifdef CALLSTACK
+
+#include <stdint.h>
+#include <stdio.h>
+
+void callstackInit(uint16_t entry, uint64_t cycles);
+// After the return address has been pushed and pc set to the target
+void callstackCall(uint16_t target, uint16_t sp, uint64_t cycles);
+// Before the return address is popped from sp
+void callstackReturn(uint16_t sp, uint64_t cycles);
+
+// Inclusive and exclusive cycles per routine, hottest first
+void callstackReport(FILE *out, uint64_t cycles);
+// One "sub_0000;sub_01e4;sub_1a32 <cycles>" line per call path, the
+// folded format flame graph tools read
+void callstackWriteFolded(FILE *out, uint64_t cycles);
+
+#endif
+
+#endif
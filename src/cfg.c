@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg.h"
+
+static inline int isJcc(uint8_t op) {
+  return opcodeTable[op].control == CTRL_JUMP_COND;
+}
+static inline int isCcc(uint8_t op) {
+  return opcodeTable[op].control == CTRL_CALL_COND;
+}
+static inline int isRcc(uint8_t op) {
+  return opcodeTable[op].control == CTRL_RET_COND;
+}
+static inline int isRst(uint8_t op) {
+  return opcodeTable[op].control == CTRL_RST;
+}
+
+// Anything after which the next instruction starts a new block. HLT resumes
+// at the next instruction once an interrupt has been serviced.
+static inline int endsBlock(uint8_t op) {
+  return isControlFlow(op) && opcodeTable[op].control != CTRL_HALT;
+}
+
+static void push(Cfg *cfg, uint16_t *worklist, int *n, uint32_t addr,
+                 uint32_t size, uint8_t flag) {
+  if (addr >= size)
+    return;
+  uint8_t old = cfg->flags[addr];
+  cfg->flags[addr] |= CFG_LEADER | flag;
+  if (!(old & CFG_LEADER))
+    worklist[(*n)++] = addr;
+}
+
+static void drain(Cfg *cfg, const uint8_t *code, uint32_t size,
+                  uint16_t *worklist, int *n) {
+  while (*n > 0) {
+    uint32_t pc = worklist[--*n];
+    while (pc < size && !(cfg->flags[pc] & CFG_CODE)) {
+      uint8_t op = code[pc];
+      int len = opcodeLength(op);
+      if (pc + len > size)
+        break;
+      cfg->flags[pc] |= CFG_CODE;
+      for (int i = 1; i < len; i++) {
+        cfg->flags[pc + i] |= CFG_OPERAND;
+      }
+
+      uint16_t target = len == 3 ? (code[pc + 2] << 8) | code[pc + 1] : 0;
+      if (op == 0xc3 || isJcc(op)) {
+        push(cfg, worklist, n, target, size, 0);
+      } else if (op == 0xcd || isCcc(op)) {
+        push(cfg, worklist, n, target, size, CFG_ROUTINE);
+      } else if (isRst(op)) {
+        push(cfg, worklist, n, op & 0x38, size, CFG_ROUTINE);
+      }
+
+      pc += len;
+      if (op == 0xc3 || op == 0xc9 || op == 0xe9)
+        break;
+      if (endsBlock(op)) {
+        push(cfg, worklist, n, pc, size, 0);
+        break;
+      }
+    }
+  }
+}
+
+static void walk(Cfg *cfg, const uint8_t *code, uint32_t size,
+                 const uint16_t *entries, int n_entries) {
+  uint16_t *worklist = malloc(CFG_ADDR_SPACE * sizeof(uint16_t));
+  int n = 0;
+
+  for (int i = 0; i < n_entries; i++) {
+    if (cfg->flags[entries[i]] & (CFG_CODE | CFG_OPERAND))
+      continue;
+    push(cfg, worklist, &n, entries[i], size, CFG_ROUTINE);
+    drain(cfg, code, size, worklist, &n);
+  }
+  free(worklist);
+}
+
+static void buildBlocks(Cfg *cfg, const uint8_t *code, uint32_t size) {
+  int cap = 0;
+  for (uint32_t addr = 0; addr < size; addr++) {
+    cap += (cfg->flags[addr] & (CFG_LEADER | CFG_CODE)) ==
+           (CFG_LEADER | CFG_CODE);
+  }
+  cfg->blocks = calloc(cap ? cap : 1, sizeof(BasicBlock));
+
+  for (uint32_t addr = 0; addr < size; addr++) {
+    if ((cfg->flags[addr] & (CFG_LEADER | CFG_CODE)) !=
+        (CFG_LEADER | CFG_CODE))
+      continue;
+
+    BasicBlock *block = &cfg->blocks[cfg->n_blocks++];
+    block->start = addr;
+    uint32_t pc = addr;
+    uint8_t op;
+    while (1) {
+      op = code[pc];
+      pc += opcodeLength(op);
+      if (endsBlock(op) || pc >= size || !(cfg->flags[pc] & CFG_CODE) ||
+          (cfg->flags[pc] & CFG_LEADER))
+        break;
+    }
+    block->end = pc;
+
+    uint32_t last = pc - opcodeLength(op);
+    uint16_t target =
+        opcodeLength(op) == 3 ? (code[last + 2] << 8) | code[last + 1] : 0;
+    block->fall = pc;
+    block->has_fall = 1;
+    if (op == 0xc3) {
+      block->kind = BLOCK_JUMP;
+      block->has_fall = 0;
+      block->has_target = 1;
+      block->target = target;
+    } else if (isJcc(op)) {
+      block->kind = BLOCK_BRANCH;
+      block->has_target = 1;
+      block->target = target;
+    } else if (op == 0xcd || isCcc(op)) {
+      block->kind = BLOCK_CALL;
+      block->has_target = 1;
+      block->target = target;
+    } else if (isRst(op)) {
+      block->kind = BLOCK_CALL;
+      block->has_target = 1;
+      block->target = op & 0x38;
+    } else if (isRcc(op)) {
+      block->kind = BLOCK_BRANCH;
+    } else if (op == 0xc9) {
+      block->kind = BLOCK_RET;
+      block->has_fall = 0;
+    } else if (op == 0xe9) {
+      block->kind = BLOCK_PCHL;
+      block->has_fall = 0;
+    } else {
+      block->kind = BLOCK_FALL;
+    }
+  }
+}
+
+static BasicBlock *findBlock(Cfg *cfg, uint16_t start) {
+  int lo = 0, hi = cfg->n_blocks - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (cfg->blocks[mid].start == start)
+      return &cfg->blocks[mid];
+    if (cfg->blocks[mid].start < start)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return NULL;
+}
+
+static void addCall(Cfg *cfg, int *cap, uint16_t caller, uint16_t callee) {
+  for (int i = 0; i < cfg->n_calls; i++) {
+    if (cfg->calls[i].caller == caller && cfg->calls[i].callee == callee)
+      return;
+  }
+  if (cfg->n_calls == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    cfg->calls = realloc(cfg->calls, *cap * sizeof(CallEdge));
+  }
+  cfg->calls[cfg->n_calls++] = (CallEdge){caller, callee};
+}
+
+// Walks each routine's blocks without following calls. A jump into another
+// routine's entry is treated as a tail call. Blocks belong to the first
+// routine (in address order) that reaches them.
+static void buildCallGraph(Cfg *cfg) {
+  int n_blocks = cfg->n_blocks ? cfg->n_blocks : 1;
+  uint8_t *owned = calloc(n_blocks, 1);
+  uint8_t *seen = calloc(n_blocks, 1);
+  int *stack = malloc(n_blocks * sizeof(int));
+  int cap = 0;
+
+  for (int r = 0; r < cfg->n_blocks; r++) {
+    uint16_t routine = cfg->blocks[r].start;
+    if (!(cfg->flags[routine] & CFG_ROUTINE))
+      continue;
+
+    memset(seen, 0, n_blocks);
+    int n = 0;
+    stack[n++] = r;
+    seen[r] = 1;
+    while (n > 0) {
+      int idx = stack[--n];
+      BasicBlock *block = &cfg->blocks[idx];
+      if (!owned[idx]) {
+        owned[idx] = 1;
+        block->routine = routine;
+      }
+      if (block->kind == BLOCK_CALL)
+        addCall(cfg, &cap, routine, block->target);
+
+      uint16_t succ[2];
+      int n_succ = 0;
+      if (block->has_target && block->kind != BLOCK_CALL)
+        succ[n_succ++] = block->target;
+      if (block->has_fall)
+        succ[n_succ++] = block->fall;
+      for (int i = 0; i < n_succ; i++) {
+        BasicBlock *next = findBlock(cfg, succ[i]);
+        if (next == NULL || seen[next - cfg->blocks])
+          continue;
+        if (cfg->flags[next->start] & CFG_ROUTINE) {
+          addCall(cfg, &cap, routine, next->start);
+          continue;
+        }
+        seen[next - cfg->blocks] = 1;
+        stack[n++] = next - cfg->blocks;
+      }
+    }
+  }
+  free(stack);
+  free(seen);
+  free(owned);
+}
+
+void cfgAnalyse(Cfg *cfg, const uint8_t *code, uint32_t size,
+                const uint16_t *entries, int n_entries) {
+  if (size > CFG_ADDR_SPACE)
+    size = CFG_ADDR_SPACE;
+  walk(cfg, code, size, entries, n_entries);
+  buildBlocks(cfg, code, size);
+  buildCallGraph(cfg);
+}
+
+void cfgFree(Cfg *cfg) {
+  free(cfg->blocks);
+  free(cfg->calls);
+  memset(cfg, 0, sizeof(Cfg));
+}
+
+int cfgDefaultEntries(uint16_t *entries) {
+  int n = 0;
+  for (uint16_t vec = 0x00; vec <= 0x38; vec += 8) {
+    entries[n++] = vec;
+  }
+  return n;
+}
+
+static const char *kindName(uint8_t kind) {
+  switch (kind) {
+  case BLOCK_JUMP:
+    return "jump";
+  case BLOCK_BRANCH:
+    return "branch";
+  case BLOCK_CALL:
+    return "call";
+  case BLOCK_RET:
+    return "ret";
+  case BLOCK_PCHL:
+    return "pchl";
+  default:
+    return "fall";
+  }
+}
+
+// block <start> <end> <kind> <target|-> <fallthrough|-> <routine>
+// routine <entry>
+// call <caller routine> <callee>
+void cfgWriteBlockMap(const Cfg *cfg, FILE *out) {
+  fprintf(out, "# 8080 block map: block start end kind target fall routine\n");
+  for (int i = 0; i < cfg->n_blocks; i++) {
+    const BasicBlock *block = &cfg->blocks[i];
+    fprintf(out, "block %04x %04x %s ", block->start, block->end,
+            kindName(block->kind));
+    if (block->has_target)
+      fprintf(out, "%04x ", block->target);
+    else
+      fprintf(out, "- ");
+    if (block->has_fall)
+      fprintf(out, "%04x ", block->fall);
+    else
+      fprintf(out, "- ");
+    fprintf(out, "%04x\n", block->routine);
+  }
+  for (int i = 0; i < cfg->n_blocks; i++) {
+    if (cfg->flags[cfg->blocks[i].start] & CFG_ROUTINE)
+      fprintf(out, "routine %04x\n", cfg->blocks[i].start);
+  }
+  for (int i = 0; i < cfg->n_calls; i++) {
+    fprintf(out, "call %04x %04x\n", cfg->calls[i].caller,
+            cfg->calls[i].callee);
+  }
+}
+
+int cfgReadBlockMap(FILE *in, uint16_t *entries, int max) {
+  char line[128];
+  int n = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    unsigned int addr;
+    if (line[0] == '#' || line[0] == '\n' || strncmp(line, "call ", 5) == 0)
+      continue;
+    if (sscanf(line, "block %x", &addr) != 1 &&
+        sscanf(line, "routine %x", &addr) != 1)
+      return -1;
+    if (n < max)
+      entries[n++] = addr;
+  }
+  return n;
+}
@@ -0,0 +1,69 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "opcodes.h"
+
+#define CFG_ADDR_SPACE 0x10000
+
+// Per-address flags
+#define CFG_CODE 0x01    // first byte of a reached instruction
+#define CFG_LEADER 0x02  // first instruction of a basic block
+#define CFG_ROUTINE 0x04 // entry point or CALL/RST target
+#define CFG_OPERAND 0x08 // operand byte of a reached instruction
+
+enum {
+  BLOCK_FALL,   // runs into the next block
+  BLOCK_JUMP,   // JMP
+  BLOCK_BRANCH, // Jcc, taken and fallthrough successors
+  BLOCK_CALL,   // CALL, Ccc or RST; returns to the fallthrough successor
+  BLOCK_RET,    // RET; Rcc is BLOCK_BRANCH with no taken successor
+  BLOCK_PCHL,   // computed jump, successors unknown
+};
+
+typedef struct {
+  uint16_t start;
+  uint16_t end; // one past the last byte of the last instruction
+  uint8_t kind;
+  uint8_t has_target;
+  uint8_t has_fall;
+  uint16_t target; // jump or call target
+  uint16_t fall;   // address after the block
+  uint16_t routine; // routine whose walk first reached this block
+} BasicBlock;
+
+typedef struct {
+  uint16_t caller; // routine entry
+  uint16_t callee;
+} CallEdge;
+
+typedef struct {
+  uint8_t flags[CFG_ADDR_SPACE];
+  BasicBlock *blocks; // sorted by start address
+  int n_blocks;
+  CallEdge *calls; // unique caller/callee pairs
+  int n_calls;
+} Cfg;
+
+// Recursive descent from the given entry points over size bytes of code.
+// Follows JMP, Jcc, CALL, Ccc and RST targets; PCHL ends a path. Entries are
+// walked in order and one that lands on code already reached is skipped
+// (unused RST vectors often hold the tail of the previous handler). The Cfg
+// must be zeroed (or freshly cfgFree'd) before the call.
+void cfgAnalyse(Cfg *cfg, const uint8_t *code, uint32_t size,
+                const uint16_t *entries, int n_entries);
+void cfgFree(Cfg *cfg);
+
+// The reset vector and the eight RST vectors
+int cfgDefaultEntries(uint16_t *entries);
+
+// Block map: one "block", "routine" or "call" record per line, addresses in
+// hex. See cfgWriteBlockMap for the exact layout.
+void cfgWriteBlockMap(const Cfg *cfg, FILE *out);
+// Reads the block and routine start addresses of a block map into entries
+// (at most max). Returns how many were read, -1 on a malformed line.
+int cfgReadBlockMap(FILE *in, uint16_t *entries, int max);
+
+#endif
@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "coverage.h"
+
+static uint8_t bucket[256];
+
+static void initBuckets(void) {
+  for (int hits = 1; hits < 256; hits++) {
+    if (hits <= 3)
+      bucket[hits] = 1 << (hits - 1);
+    else if (hits < 8)
+      bucket[hits] = 0x08;
+    else if (hits < 16)
+      bucket[hits] = 0x10;
+    else if (hits < 32)
+      bucket[hits] = 0x20;
+    else if (hits < 128)
+      bucket[hits] = 0x40;
+    else
+      bucket[hits] = 0x80;
+  }
+}
+
+void coverageClear(Coverage *cov) {
+  memset(cov->pcs, 0, sizeof(cov->pcs));
+  for (int w = 0; w < COVERAGE_SIZE / 64 / 64; w++) {
+    for (uint64_t lines = cov->lines[w]; lines; lines &= lines - 1) {
+      int line = w * 64 + __builtin_ctzll(lines);
+      memset(&cov->edges[line * 64], 0, 64);
+    }
+    cov->lines[w] = 0;
+  }
+}
+
+int coverageMerge(Coverage *total, const Coverage *run) {
+  if (bucket[1] == 0)
+    initBuckets();
+
+  int added = 0;
+  const uint64_t *run_pcs = (const uint64_t *)run->pcs;
+  uint64_t *total_pcs = (uint64_t *)total->pcs;
+  for (int w = 0; w < COVERAGE_SIZE / 64; w++) {
+    uint64_t fresh = run_pcs[w] & ~total_pcs[w];
+    if (fresh) {
+      added += __builtin_popcountll(fresh);
+      total_pcs[w] |= fresh;
+    }
+  }
+
+  // runs touch few edges: only the lines they hit
+  for (int w = 0; w < COVERAGE_SIZE / 64 / 64; w++) {
+    for (uint64_t lines = run->lines[w]; lines; lines &= lines - 1) {
+      int line = w * 64 + __builtin_ctzll(lines);
+      for (int i = line * 64; i < line * 64 + 64; i++) {
+        uint8_t fresh = bucket[run->edges[i]] & ~total->edges[i];
+        if (fresh) {
+          added += __builtin_popcount(fresh);
+          total->edges[i] |= fresh;
+        }
+      }
+    }
+  }
+  return added;
+}
+
+void coverageCount(const Coverage *cov, int *pcs, int *edges) {
+  *pcs = 0;
+  *edges = 0;
+  for (int i = 0; i < COVERAGE_SIZE / 8; i++) {
+    *pcs += __builtin_popcount(cov->pcs[i]);
+  }
+  for (int i = 0; i < COVERAGE_SIZE; i++) {
+    *edges += cov->edges[i] != 0;
+  }
+}
+
+void coverageWrite(FILE *out, const Coverage *cov) {
+  for (int addr = 0; addr < COVERAGE_SIZE; addr++) {
+    if (cov->pcs[addr >> 3] & (1 << (addr & 7)))
+      fprintf(out, "pc %04x\n", addr);
+  }
+  for (int i = 0; i < COVERAGE_SIZE; i++) {
+    if (cov->edges[i])
+      fprintf(out, "edge %04x %u\n", i, cov->edges[i]);
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+// Code coverage of a run: one bit per executed instruction address, plus
+// taken control transfers as AFL-style edges, (from, to) hashed into a
+// fixed 64 KB map of saturating hit counts. Fixed size keeps clearing and
+// comparing runs a flat scan, whatever the program does; a run marks the
+// 64-byte lines of the map it hit, so the scan skips the rest.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define COVERAGE_SIZE 0x10000
+
+typedef struct {
+  uint8_t pcs[COVERAGE_SIZE / 8];
+  uint8_t edges[COVERAGE_SIZE];
+  uint64_t lines[COVERAGE_SIZE / 64 / 64]; // edges lines with a hit
+} Coverage;
+
+static inline uint16_t coverageEdge(uint16_t from, uint16_t to) {
+  return (uint16_t)(from * 0x9e37u) ^ to;
+}
+
+// The len-byte instruction at from left pc at to. Falling through to the
+// next instruction is not an edge.
+static inline void coverageStep(Coverage *cov, uint16_t from, uint16_t to,
+                                int len) {
+  cov->pcs[from >> 3] |= 1 << (from & 7);
+  if (to != (uint16_t)(from + len)) {
+    uint16_t edge = coverageEdge(from, to);
+    uint8_t *hits = &cov->edges[edge];
+    *hits += *hits != 0xff;
+    cov->lines[edge >> 12] |= 1ull << ((edge >> 6) & 63);
+  }
+}
+
+// The branch at from jumped to to n more times, for loops run at once
+static inline void coverageLoop(Coverage *cov, uint16_t from, uint16_t to,
+                                uint32_t n) {
+  uint16_t edge = coverageEdge(from, to);
+  uint8_t *hits = &cov->edges[edge];
+  *hits = *hits + n < 0xff ? *hits + n : 0xff;
+  cov->lines[edge >> 12] |= 1ull << ((edge >> 6) & 63);
+}
+
+void coverageClear(Coverage *cov);
+
+// Folds a run into total, where each edge keeps a bit per hit-count bucket
+// (1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+) ever seen. Returns how many
+// addresses and buckets the run added; 0 means nothing new.
+int coverageMerge(Coverage *total, const Coverage *run);
+
+void coverageCount(const Coverage *cov, int *pcs, int *edges);
+
+// "pc <addr>" per executed address, then "edge <index> <hits>"
+void coverageWrite(FILE *out, const Coverage *cov);
+
+#endif
@@ -0,0 +1,214 @@
+#include <string.h>
+
+#include "debug.h"
+#include "disasm.h"
+#include "fusion.h"
+#include "opcodes.h"
+#include "timeline.h"
+
+// Longest superinstruction; a breakpoint unfuses any that start this close
+// before it
+#define MAX_FUSED 10
+
+static void patch(Debugger *debugger) {
+  if (debugger->trapped)
+    return;
+  memcpy(debugger->kinds, debugger->orig, DEBUG_SPACE);
+  for (uint32_t addr = 0; addr < DEBUG_SPACE; addr++) {
+    if (!debugIsBreak(debugger, addr))
+      continue;
+    for (uint32_t start = addr >= MAX_FUSED ? addr - MAX_FUSED : 0;
+         start < addr; start++) {
+      if (start + fusionLength(debugger->kinds[start]) > addr)
+        debugger->kinds[start] = FUSE_NONE;
+    }
+    debugger->kinds[addr] = FUSE_BREAK;
+  }
+}
+
+void debugAttach(Debugger *debugger, CPUState *state, uint8_t *kinds) {
+  memset(debugger, 0, sizeof(Debugger));
+  debugger->kinds = kinds;
+  memcpy(debugger->orig, kinds, DEBUG_SPACE);
+  state->debugger = debugger;
+}
+
+int debugIsBreak(const Debugger *debugger, uint16_t addr) {
+  return (debugger->breaks[addr >> 3] >> (addr & 7)) & 1;
+}
+
+void debugSetBreak(Debugger *debugger, uint16_t addr, int on) {
+  if (on)
+    debugger->breaks[addr >> 3] |= 1 << (addr & 7);
+  else
+    debugger->breaks[addr >> 3] &= ~(1 << (addr & 7));
+  patch(debugger);
+}
+
+void debugSetWatch(Debugger *debugger, CPUState *state, uint16_t addr,
+                   uint32_t len, uint8_t bits, int on) {
+  // accesses are masked to the mirrored memory before they're matched
+  // (memRead/memWrite), so watches are too
+  if (len > MEMORY_SIZE)
+    len = MEMORY_SIZE;
+  for (uint32_t i = 0; i < len; i++) {
+    uint16_t at = (addr + i) & (MEMORY_SIZE - 1);
+    if (on)
+      debugger->watches[at] |= bits;
+    else
+      debugger->watches[at] &= ~bits;
+  }
+
+  // a page takes the slow path while any byte in it is watched
+  for (uint32_t page = 0; page < MEMORY_SIZE >> 8; page++) {
+    uint8_t flags = 0;
+    for (int i = 0; i < 256; i++) {
+      flags |= debugger->watches[(page << 8) | i];
+    }
+    flags &= PAGE_WATCH_READ | PAGE_WATCH_WRITE;
+    state->page_flags[page] =
+        (state->page_flags[page] & ~(PAGE_WATCH_READ | PAGE_WATCH_WRITE)) |
+        flags;
+  }
+}
+
+void debugTrapAll(Debugger *debugger) {
+  memset(debugger->kinds, FUSE_BREAK, DEBUG_SPACE);
+  debugger->trapped = 1;
+}
+
+void debugStep(Debugger *debugger) {
+  debugger->stepping = 1;
+  debugTrapAll(debugger);
+}
+
+void debugWatchHit(CPUState *state, uint16_t addr, uint8_t write) {
+  Debugger *debugger = state->debugger;
+  uint8_t bit = write ? PAGE_WATCH_WRITE : PAGE_WATCH_READ;
+  if (debugger == NULL || !(debugger->watches[addr] & bit))
+    return;
+  debugger->watch_hit = 1;
+  debugger->watch_write = write;
+  debugger->watch_addr = addr;
+  debugger->watch_pc = state->pc;
+  if (!debugger->replaying)
+    debugTrapAll(debugger);
+}
+
+int debugStop(Debugger *debugger, CPUState *state) {
+  int reason = STOP_BREAK;
+  if (debugger->watch_hit)
+    reason = STOP_WATCH;
+  else if (debugger->stepping && !debugIsBreak(debugger, state->pc))
+    reason = STOP_STEP;
+
+  debugger->trapped = 0;
+  debugger->stepping = 0;
+  debugger->watch_hit = 0;
+  patch(debugger);
+  return reason;
+}
+
+static void printState(FILE *out, const CPUState *state) {
+  char text[DISASM_MAX];
+  disassemble(&state->memory[state->pc], text);
+  fprintf(out,
+          "  pc %04x  %-16s a %02x  bc %02x%02x  de %02x%02x  hl %02x%02x  "
+          "sp %04x  %c%c%c%c%c  cycles %llu\n",
+          state->pc, text, state->a, state->b, state->c, state->d, state->e,
+          state->h, state->l, state->sp, state->cc.s ? 'S' : '-',
+          state->cc.z ? 'Z' : '-', state->cc.ac ? 'A' : '-',
+          state->cc.p ? 'P' : '-', state->cc.cy ? 'C' : '-',
+          (unsigned long long)state->cycles);
+}
+
+static void listCode(FILE *out, const CPUState *state, uint32_t addr, int n) {
+  for (int i = 0; i < n && addr + 3 <= MEMORY_SIZE; i++) {
+    char text[DISASM_MAX];
+    disassemble(&state->memory[addr], text);
+    fprintf(out, "  %04x  %s\n", addr, text);
+    addr += opcodeLength(state->memory[addr]);
+  }
+}
+
+static void dumpMemory(FILE *out, const CPUState *state, uint32_t addr,
+                       uint32_t n) {
+  for (uint32_t row = addr; row < addr + n && row < MEMORY_SIZE; row += 16) {
+    fprintf(out, "  %04x ", row);
+    for (uint32_t i = row; i < row + 16 && i < addr + n && i < MEMORY_SIZE;
+         i++) {
+      fprintf(out, " %02x", state->memory[i]);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+static const char *help =
+    "  b ADDR        set breakpoint        bc ADDR      clear breakpoint\n"
+    "  w ADDR [LEN]  watch writes          rw ADDR [LEN] watch reads\n"
+    "  wc ADDR [LEN] clear watches         r            registers\n"
+    "  x ADDR [LEN]  dump memory           l [ADDR]     disassemble\n"
+    "  s             step                  c            continue\n"
+    "  rs            reverse step          rc           reverse continue\n"
+    "  q             quit\n";
+
+static void printStop(FILE *out, const Debugger *debugger,
+                      const CPUState *state, int reason) {
+  if (reason == STOP_WATCH)
+    fprintf(out, "watch: %04x %s %04x\n", debugger->watch_pc,
+            debugger->watch_write ? "wrote" : "read", debugger->watch_addr);
+  else if (reason == STOP_BREAK)
+    fprintf(out, "breakpoint %04x\n", state->pc);
+  else if (reason < 0)
+    fprintf(out, "start of history\n");
+  printState(out, state);
+}
+
+int debugMonitor(Debugger *debugger, CPUState *state, int reason, FILE *in,
+                 FILE *out) {
+  printStop(out, debugger, state, reason);
+
+  char line[128];
+  while (fprintf(out, "(8080) "), fflush(out), fgets(line, sizeof(line), in)) {
+    char cmd[8];
+    unsigned int addr, len = 1;
+    int n = sscanf(line, "%7s %x %x", cmd, &addr, &len);
+    if (n < 1)
+      continue;
+
+    if (strcmp(cmd, "c") == 0) {
+      return DEBUG_CONTINUE;
+    } else if (strcmp(cmd, "s") == 0) {
+      debugStep(debugger);
+      return DEBUG_CONTINUE;
+    } else if (strcmp(cmd, "q") == 0) {
+      return DEBUG_QUIT;
+    } else if (debugger->timeline != NULL && strcmp(cmd, "rs") == 0) {
+      int ok = timelineReverseStep(debugger->timeline, state);
+      printStop(out, debugger, state, ok ? STOP_STEP : -1);
+    } else if (debugger->timeline != NULL && strcmp(cmd, "rc") == 0) {
+      printStop(out, debugger, state,
+                timelineReverseContinue(debugger->timeline, state, debugger));
+    } else if (strcmp(cmd, "r") == 0) {
+      printState(out, state);
+    } else if (strcmp(cmd, "l") == 0) {
+      listCode(out, state, n >= 2 ? addr : state->pc, 8);
+    } else if (n >= 2 && strcmp(cmd, "b") == 0) {
+      debugSetBreak(debugger, addr, 1);
+    } else if (n >= 2 && strcmp(cmd, "bc") == 0) {
+      debugSetBreak(debugger, addr, 0);
+    } else if (n >= 2 && strcmp(cmd, "w") == 0) {
+      debugSetWatch(debugger, state, addr, len, PAGE_WATCH_WRITE, 1);
+    } else if (n >= 2 && strcmp(cmd, "rw") == 0) {
+      debugSetWatch(debugger, state, addr, len, PAGE_WATCH_READ, 1);
+    } else if (n >= 2 && strcmp(cmd, "wc") == 0) {
+      debugSetWatch(debugger, state, addr, len,
+                    PAGE_WATCH_READ | PAGE_WATCH_WRITE, 0);
+    } else if (n >= 2 && strcmp(cmd, "x") == 0) {
+      dumpMemory(out, state, addr, n >= 3 ? len : 64);
+    } else {
+      fprintf(out, "%s", help);
+    }
+  }
+  return DEBUG_QUIT;
+}
@@ -0,0 +1,81 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+// Breakpoints and watchpoints that cost nothing while none are hit.
+//
+// A breakpoint is FUSE_BREAK written into the run loop's predecode table,
+// which already has an entry for every address and is already consulted
+// before each dispatch; a superinstruction spanning the address is unfused.
+// A watchpoint flags its 256-byte pages in CPUState.page_flags so memRead
+// and memWrite hand accesses there to debugWatchHit. Stopping before the
+// next instruction (after a watch hit or for a single step) fills the whole
+// table with FUSE_BREAK until the stop is handled.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emu.h"
+
+#define DEBUG_SPACE 0x10000
+
+// In Debugger.watches next to the PAGE_WATCH_* bits: the watch was set as
+// one on any access (gdb's awatch), so a hit is reported as such
+#define DEBUG_WATCH_ACCESS 0x80
+
+// Why the run loop stopped
+enum {
+  STOP_BREAK, // breakpoint at pc
+  STOP_STEP,  // single step finished
+  STOP_WATCH, // watched address accessed by the previous instruction
+};
+
+enum {
+  DEBUG_CONTINUE,
+  DEBUG_QUIT,
+};
+
+typedef struct Debugger {
+  uint8_t *kinds;            // the run loop's predecode table, patched
+  uint8_t orig[DEBUG_SPACE]; // kinds as predecoded
+  uint8_t breaks[DEBUG_SPACE / 8];
+  uint8_t watches[MEMORY_SIZE]; // PAGE_WATCH_*, DEBUG_WATCH_ACCESS
+  uint8_t trapped;              // every entry of kinds is FUSE_BREAK
+  uint8_t stepping;
+  uint8_t replaying; // re-executing history: watch hits are only recorded
+  struct Timeline *timeline; // reverse execution, may be NULL
+  // the last watch hit
+  uint8_t watch_hit;
+  uint8_t watch_write;
+  uint16_t watch_addr;
+  uint16_t watch_pc;
+} Debugger;
+
+// kinds must have DEBUG_SPACE entries. Sets state->debugger.
+void debugAttach(Debugger *debugger, CPUState *state, uint8_t *kinds);
+
+void debugSetBreak(Debugger *debugger, uint16_t addr, int on);
+int debugIsBreak(const Debugger *debugger, uint16_t addr);
+// bits are PAGE_WATCH_READ and/or PAGE_WATCH_WRITE, plus DEBUG_WATCH_ACCESS
+// for an access watch; on = 0 clears them.
+// Addresses are taken modulo MEMORY_SIZE, as the board decodes them.
+void debugSetWatch(Debugger *debugger, CPUState *state, uint16_t addr,
+                   uint32_t len, uint8_t bits, int on);
+// Stop before the next instruction, whatever it is
+void debugTrapAll(Debugger *debugger);
+// The same, reported as a single step rather than a breakpoint
+void debugStep(Debugger *debugger);
+
+// Slow path of memRead/memWrite for flagged pages
+void debugWatchHit(CPUState *state, uint16_t addr, uint8_t write);
+
+// Called by the run loop on FUSE_BREAK. Undoes the trap and returns a
+// STOP_* reason; the caller then runs the instruction at pc unfused.
+int debugStop(Debugger *debugger, CPUState *state);
+
+// Interactive monitor on in/out for a stop. Returns DEBUG_QUIT to end the
+// run; otherwise execution resumes, with debugger->stepping set to stop
+// again after one instruction.
+int debugMonitor(Debugger *debugger, CPUState *state, int reason, FILE *in,
+                 FILE *out);
+
+#endif
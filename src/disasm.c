@@ -0,0 +1,54 @@
+#include <string.h>
+
+#include "disasm.h"
+#include "opcodes.h"
+
+typedef struct {
+  char text[DISASM_MAX]; // mnemonic and, for operand forms, ", "
+  uint8_t len;
+} Template;
+
+static Template templates[256];
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// The templates are derived from opcodeTable once, when the program loads,
+// so formatting is two copies and a few digit lookups.
+__attribute__((constructor)) static void buildTemplates(void) {
+  for (int op = 0; op < 256; op++) {
+    const OpcodeInfo *info = &opcodeTable[op];
+    Template *t = &templates[op];
+    size_t len = strlen(info->mnemonic);
+    memcpy(t->text, info->mnemonic, len);
+    if (info->length > 1) {
+      t->text[len++] = ',';
+      t->text[len++] = ' ';
+    }
+    t->len = len;
+  }
+}
+
+char *disasmHex(char *p, uint32_t value, int digits) {
+  for (int i = digits - 1; i >= 0; i--) {
+    p[i] = hex_digits[value & 0xf];
+    value >>= 4;
+  }
+  return p + digits;
+}
+
+int disassemble(const uint8_t *code, char *buf) {
+  const Template *t = &templates[code[0]];
+  memcpy(buf, t->text, t->len);
+  char *p = buf + t->len;
+
+  switch (opcodeTable[code[0]].length) {
+  case 3:
+    p = disasmHex(p, (code[2] << 8) | code[1], 4);
+    break;
+  case 2:
+    p = disasmHex(p, code[1], 2);
+    break;
+  }
+  *p = '\0';
+  return p - buf;
+}
@@ -0,0 +1,20 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest text disassemble writes: "LXI SP, ffff" plus the NUL
+#define DISASM_MAX 16
+
+// Formats the instruction at code into buf, which must hold DISASM_MAX
+// bytes, in the same "MNEMONIC, operand" form the disassembler prints.
+// Returns the text length; the instruction length is opcodeLength(code[0]).
+// No stdio: meant for tracing and profiling millions of instructions.
+int disassemble(const uint8_t *code, char *buf);
+
+// Writes value as the given number of lowercase hex digits at p and returns
+// the end
+char *disasmHex(char *p, uint32_t value, int digits);
+
+#endif
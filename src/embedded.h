@@ -0,0 +1,31 @@
+#ifndef EMBEDDED_H
+#define EMBEDDED_H
+
+// Built with EMBED_ROM (CMakeLists.txt): a ROM and the machine as it stands
+// once booted on the Invaders board, in attract mode, generated by 8080boot
+// at build time. Starting from it skips the boot and its RAM tests.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "emu.h"
+#include "invaders.h"
+#include "snapshot.h"
+
+// Memory is MEMORY_SIZE bytes, ROM included; device is the InvadersBoard
+extern const Snapshot embeddedBoot;
+// Bytes of embeddedBoot.memory that are ROM
+extern const uint32_t embeddedRomSize;
+// Frames run from reset to take embeddedBoot
+extern const uint32_t embeddedBootFrames;
+
+// Cold start for a machine with MEMORY_SIZE bytes of plain memory: one
+// memcpy, then the registers and board. Machines with shared ROM pages
+// (arena.h) take snapshotClone(&embeddedBoot, ...) instead.
+static inline void embeddedStart(CPUState *state, InvadersBoard *board) {
+  memcpy(state->memory, embeddedBoot.memory, MEMORY_SIZE);
+  memset(state->dirty, 0, sizeof(state->dirty));
+  snapshotRestore(&embeddedBoot, state, board);
+}
+
+#endif
@@ -5,9 +5,13 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include "emu.h"
+#include "fusion.h"
+#include "opcodes.h"
+#include "ops.h"
 
 void printByte(uint8_t x) {
   int num_bits = 8;
@@ -27,1064 +31,303 @@ void unimplementedOpcodeError(uint8_t opcode) {
   exit(EXIT_FAILURE);
 }
 
-static inline uint16_t get16Bit(uint8_t hb, uint8_t lb) {
-  return (hb << 8) | lb;
-}
-
-static inline uint8_t getMReg(CPUState *state) {
-  uint16_t addr = get16Bit(state->h, state->l);
-  return state->memory[addr];
-}
-
-static inline void setMReg(CPUState *state, uint8_t data) {
-  uint16_t addr = get16Bit(state->h, state->l);
-  state->memory[addr] = data;
+void handleOpcode(CPUState *state, uint8_t *registers[]) {
+  execOpcode(state, registers, &state->memory[state->pc]);
 }
 
-static inline uint8_t parity(uint8_t x) {
-  uint8_t n_one = 0;
-  for (uint8_t i = 0; i < 8; i++) {
-    if (x >> i)
-      n_one += 1;
+// Clock states of the n instructions starting at code
+static inline uint32_t sequenceCycles(const uint8_t *code, int n) {
+  uint32_t cycles = 0;
+  for (int i = 0; i < n; i++) {
+    cycles += opcodeTable[*code].cycles;
+    code += opcodeTable[*code].length;
   }
-  return (n_one & 1) == 0;
-}
-
-static inline uint8_t sign(uint8_t x) { return (x & 0x80) != 0; }
-
-static inline void i8080_lda(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
-  state->a = state->memory[addr];
-  state->pc += 3;
-}
-
-static inline uint8_t checkCond(CPUState *state, uint8_t flag) {
-  assert(flag <= 7);
-
-  switch (flag) {
-  case 0: // not zero
-    return state->cc.z == 0;
-    break;
-  case 1: // zero
-    return state->cc.z == 1;
-    break;
-  case 2: // no carry
-    return state->cc.cy == 0;
-    break;
-  case 3: // carry
-    return state->cc.cy == 1;
-    break;
-  case 4: // parity odd
-    return state->cc.p == 0;
-    break;
-  case 5: // parity even
-    return state->cc.p == 1;
-    break;
-  case 6: // pos
-    return state->cc.s == 0;
-    break;
-  case 7: // neg
-    return state->cc.s == 1;
-    break;
-  default:
-    exit(EXIT_FAILURE);
+  return cycles;
+}
+
+// Block loops are only collapsed when every byte they store lands in RAM and
+// a copy's source and destination don't overlap (a forward byte copy over
+// itself repeats a pattern, which memcpy doesn't reproduce). Otherwise the
+// loop runs one instruction at a time.
+static inline uint8_t inRam(uint16_t addr, uint16_t n) {
+  return addr >= ROM_SIZE && addr + n <= MEMORY_SIZE;
+}
+
+// memcpy/memset would skip memRead/memWrite, so a range touching a page
+// with any of the given PAGE_* flags (a watchpoint, shared ROM) runs one
+// instruction at a time too
+static inline uint8_t unflagged(const CPUState *state, uint16_t addr,
+                                uint16_t n, uint8_t flags) {
+  for (uint32_t page = addr >> 8; page <= (uint32_t)(addr + n - 1) >> 8;
+       page++) {
+    if (state->page_flags[page] & flags)
+      return 0;
   }
-}
-
-static inline void i8080_sta(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
-  state->memory[addr] = state->a;
-  state->pc += 3;
-}
-
-static inline void i8080_lhld(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
-  state->l = state->memory[addr];
-  state->h = state->memory[addr + 1];
-  state->pc += 3;
-}
-
-static inline void i8080_shld(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
-  state->memory[addr] = state->l;
-  state->memory[addr + 1] = state->h;
-  state->pc += 3;
-}
-
-static inline void i8080_xchg(CPUState *state) {
-  uint8_t tmp = state->h;
-  state->h = state->d;
-  state->d = tmp;
-  tmp = state->l;
-  state->l = state->e;
-  state->e = tmp;
-  state->pc += 1;
-}
-
-static inline void i8080_adi(CPUState *state, uint8_t db, uint8_t carry) {
-  uint16_t val = state->a + db + carry;
-
-  state->cc.z = (val & 0xff) == 0;
-  state->cc.s = sign(val);
-  state->cc.cy = val > 0xff;
-  state->cc.p = parity(val);
-  state->cc.ac = ((state->a & 0x08) || (db & 0x08)) && (!(val & 0x08));
-
-  state->a = val & 0xff;
+  return 1;
+}
+
+#define STORE_FLAGS (PAGE_WATCH_WRITE | PAGE_ROM)
+
+// Whole iterations, of the n left, that end by the next device event. One
+// instruction at a time the event is taken at the first boundary at or past
+// it, so stopping there takes it at the same one.
+static inline uint16_t iterationsBefore(const CPUState *state, uint16_t n,
+                                        uint32_t iteration_cycles) {
+  if (state->next_event == 0)
+    return n;
+  if (state->cycles >= state->next_event)
+    return 0;
+  uint64_t fit = (state->next_event - state->cycles) / iteration_cycles;
+  return fit < n ? fit : n;
+}
+
+// LDAX D ; MOV M,A ; INX H ; INX D ; DCR B ; JNZ loop
+static inline uint8_t i8080_loop_copy(CPUState *state, const uint8_t *code,
+                                      uint8_t *registers[]) {
+  uint16_t left = state->b ? state->b : 256;
+  // every iteration costs the same, Jcc takes as long either way
+  uint32_t iteration_cycles = sequenceCycles(code, 6);
+  uint16_t n = iterationsBefore(state, left, iteration_cycles);
+  uint16_t src = get16Bit(state->d, state->e);
+  uint16_t dst = get16Bit(state->h, state->l);
+  if (n == 0 || !inRam(dst, n) || src + n > MEMORY_SIZE ||
+      (src < dst + n && dst < src + n) ||
+      !unflagged(state, src, n, PAGE_WATCH_READ) ||
+      !unflagged(state, dst, n, STORE_FLAGS))
+    return 0;
+
+  state->cycles += n * iteration_cycles;
+  state->instructions += n * 6;
+#ifdef MEMSTATS
+  memstatsReadRange(src, n);
+  memstatsWriteRange(dst, n, state->pc);
+#endif
+  memcpy(&state->memory[dst], &state->memory[src], n);
+  markDirty(state, dst, n);
+  state->a = state->memory[src + n - 1];
+  src += n;
+  dst += n;
+  state->d = src >> 8;
+  state->e = src & 0xff;
+  state->h = dst >> 8;
+  state->l = dst & 0xff;
+
+  // replay the last DCR B so the flags come from the same helper, then
+  // loop again if the event cut the run short
+  uint16_t loop = state->pc;
+  state->b = left - n + 1;
+  state->pc += 4;
+  i8080_dcr(state, 0x05, registers);
+  state->pc = n < left ? loop : loop + 8;
+  return 1;
+}
+
+// MOV M,A ; INX H ; DCR B ; JNZ loop
+static inline uint8_t i8080_loop_fill(CPUState *state, const uint8_t *code,
+                                      uint8_t *registers[]) {
+  uint16_t left = state->b ? state->b : 256;
+  uint32_t iteration_cycles = sequenceCycles(code, 4);
+  uint16_t n = iterationsBefore(state, left, iteration_cycles);
+  uint16_t dst = get16Bit(state->h, state->l);
+  if (n == 0 || !inRam(dst, n) || !unflagged(state, dst, n, STORE_FLAGS))
+    return 0;
+
+  state->cycles += n * iteration_cycles;
+  state->instructions += n * 4;
+#ifdef MEMSTATS
+  memstatsWriteRange(dst, n, state->pc);
+#endif
+  memset(&state->memory[dst], state->a, n);
+  markDirty(state, dst, n);
+  dst += n;
+  state->h = dst >> 8;
+  state->l = dst & 0xff;
+
+  uint16_t loop = state->pc;
+  state->b = left - n + 1;
   state->pc += 2;
-}
-
-static inline void i8080_sui(CPUState *state, uint8_t db, uint8_t carry) {
-  uint8_t val = state->a + ((~(db + carry)) + 1);
-
-  state->cc.cy = (db + carry) > state->a;
-  state->cc.s = sign(val);
-  state->cc.z = val == 0;
-  state->cc.p = parity(val);
-
-  state->a = val;
-  state->pc += 2;
-}
-
-static inline void i8080_daa(CPUState *state) {
-  uint8_t nib1 = state->a & 0x0f;
-  uint8_t nib2 = state->a >> 4;
-
-  if (nib1 > 9 || state->cc.ac)
-    nib1 += 6;
-
-  if (nib2 > 9 || state->cc.cy)
-    nib2 += 6;
-
-  uint8_t val = nib1 + (nib2 << 4);
-  state->cc.ac = (nib1 & 0xf0) != 0;
-  state->cc.cy = (nib2 & 0xf0) != 0;
-  state->cc.z = val == 0;
-  state->cc.p = parity(val);
-  state->cc.s = sign(val);
-
-  state->a = val;
-  state->pc += 1;
-}
-
-static inline void i8080_mov(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t dest_reg = (opcode >> 3) & 7;
-  uint8_t src_reg = opcode & 7;
-
-  if (src_reg == MEM_REGISTER) {
-    *registers[dest_reg] = getMReg(state);
-  } else if (dest_reg == MEM_REGISTER) {
-    setMReg(state, *registers[src_reg]);
-  } else {
-    *registers[dest_reg] = *registers[src_reg];
-  }
-  state->pc += 1;
-}
-
-static inline void i8080_mvi(CPUState *state, uint8_t opcode, uint8_t db,
-                             uint8_t *registers[]) {
-  uint8_t dest_reg = (opcode >> 3) & 7;
-
-  if (dest_reg == MEM_REGISTER) {
-    setMReg(state, db);
-  } else {
-    *registers[dest_reg] = db;
+  i8080_dcr(state, 0x05, registers);
+  state->pc = n < left ? loop : loop + 6;
+  return 1;
+}
+
+// MVI M,d8 ; INX H ; MOV A,H ; CPI d8 ; JNZ loop
+static inline uint8_t i8080_loop_clear(CPUState *state, const uint8_t *code) {
+  uint8_t db = code[1];
+  uint8_t end_page = code[5];
+  uint16_t dst = get16Bit(state->h, state->l);
+  // H already at or past the end page would wrap round all of memory
+  if (state->h >= end_page)
+    return 0;
+  uint16_t left = (end_page << 8) - dst;
+  uint32_t iteration_cycles = sequenceCycles(code, 5);
+  uint16_t n = iterationsBefore(state, left, iteration_cycles);
+  if (n == 0 || !inRam(dst, n) || !unflagged(state, dst, n, STORE_FLAGS))
+    return 0;
+
+  state->cycles += n * iteration_cycles;
+  state->instructions += n * 5;
+#ifdef MEMSTATS
+  memstatsWriteRange(dst, n, state->pc);
+#endif
+  memset(&state->memory[dst], db, n);
+  markDirty(state, dst, n);
+  dst += n;
+  state->h = dst >> 8;
+  state->l = dst & 0xff;
+  state->a = state->h;
+
+  // the last CPI compares equal and JNZ falls through, unless the event
+  // cut the run short
+  uint16_t loop = state->pc;
+  state->pc += 4;
+  i8080_cpi(state, end_page);
+  state->pc = n < left ? loop : loop + 9;
+  return 1;
+}
+
+// LDA a16 ; DCR A ; JNZ loop
+// Nothing in the loop changes what it loads, so unless the first pass
+// exits, every pass until an interrupt rewrites the byte goes the same way
+// and they all run at once.
+static inline uint8_t i8080_loop_wait(CPUState *state, const uint8_t *code,
+                                      uint8_t *registers[]) {
+  uint16_t addr = get16Bit(code[2], code[1]) & (MEMORY_SIZE - 1);
+  uint32_t iteration_cycles = sequenceCycles(code, 3);
+  uint16_t n = iterationsBefore(state, UINT16_MAX, iteration_cycles);
+  if (n == 0 || state->memory[addr] == 1 ||
+      !unflagged(state, addr, 1, PAGE_WATCH_READ))
+    return 0;
+
+  state->cycles += n * iteration_cycles;
+  state->instructions += n * 3;
+#ifdef MEMSTATS
+  for (uint16_t i = 0; i < n; i++) {
+    memstatsRead(addr);
   }
-  state->pc += 2;
-}
-
-static inline void i8080_lxi(CPUState *state, uint8_t *reg1, uint8_t *reg2,
-                             uint8_t hb, uint8_t lb) {
-  *reg1 = hb;
-  *reg2 = lb;
-  state->pc += 3;
-}
-
-static inline void i8080_lxi_sp(CPUState *state, uint8_t hb, uint8_t lb) {
-  state->sp = get16Bit(hb, lb);
-  state->pc += 3;
-}
-
-static inline void i8080_stax(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
-  state->memory[addr] = state->a;
-  state->pc += 1;
-}
-
-static inline void i8080_ldax(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
+#endif
+  uint16_t loop = state->pc;
   state->a = state->memory[addr];
-  state->pc += 1;
-}
-
-static inline void i8080_add(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[], uint8_t carry) {
-  uint8_t reg = opcode & 7;
-  uint8_t db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-  } else {
-    db = *registers[reg];
-  }
-  uint16_t val = state->a + db + carry;
-
-  state->cc.z = (val & 0xff) == 0;
-  state->cc.s = sign(val);
-  state->cc.cy = val > 0xff;
-  state->cc.p = parity(val);
-  state->cc.ac = ((state->a & 0x08) || (db & 0x08)) && ((val & 0x08) == 0);
-
-  state->a = val & 0xff;
-  state->pc += 1;
-}
-
-static inline void i8080_sub(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[], uint8_t carry) {
-
-  uint8_t reg = opcode & 7;
-  uint8_t db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-  } else {
-    db = *registers[reg];
-  }
-  db += carry;
-  uint8_t val = state->a + ((~db) + 1);
-  state->cc.cy = db > state->a;
-  state->cc.s = sign(val);
-  state->cc.z = val == 0;
-  state->cc.p = parity(val);
-
-  state->a = val;
-  state->pc += 1;
-}
-
-static inline void i8080_inr(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t reg = (opcode >> 3) & 7;
-  uint8_t val, db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-    val = db + 1;
-    setMReg(state, val);
-  } else {
-    db = *registers[reg];
-    val = db + 1;
-    *registers[reg] = val;
-  }
-
-  state->cc.z = val == 0;
-  state->cc.s = sign(val);
-  state->cc.p = parity(val);
-  state->cc.ac = (db & 0x08) && ((val & 0x08) == 0);
-
-  state->pc += 1;
-}
-
-static inline void i8080_dcr(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t reg = (opcode >> 3) & 7;
-  uint8_t val, db;
-  if (reg == MEM_REGISTER) {
-    val = getMReg(state) - 1;
-    setMReg(state, val);
-  } else {
-    val = *registers[reg] - 1;
-    *registers[reg] = val;
-  }
-
-  state->cc.z = val == 0;
-  state->cc.s = sign(val);
-  state->cc.p = parity(val);
-
-  state->pc += 1;
-}
-
-static inline void i8080_inx(CPUState *state, uint8_t *hreg, uint8_t *lreg) {
-  *lreg += 1;
-  // we overflowed
-  if (*lreg == 0) {
-    *hreg += 1;
-  }
-
-  state->pc += 1;
-}
-static inline void i8080_dcx(CPUState *state, uint8_t *hreg, uint8_t *lreg) {
-  *lreg -= 1;
-  // we underflowed
-  if (*lreg == 0xff) {
-    *hreg -= 1;
-  }
-
-  state->pc += 1;
-}
-
-static inline void i8080_dad(CPUState *state, uint8_t reg_high,
-                             uint8_t reg_low) {
-  uint16_t val = state->l + reg_low;
-  state->l = val & 0xff;
-  uint8_t cy = val > 0xff;
-  val = state->h + reg_high + cy;
-  state->h = val & 0xff;
-  state->cc.cy = val > 0xff;
-
-  state->pc += 1;
-}
-
-static inline void i8080_ana(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t reg = opcode & 7;
-  uint8_t db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-  } else {
-    db = *registers[reg];
-  }
-  state->a = state->a & db;
-  state->cc.s = sign(state->a);
-  state->cc.p = parity(state->a);
-  state->cc.z = state->a == 0;
-  state->cc.cy = 0;
-
-  state->pc += 1;
-}
-
-static inline void i8080_ani(CPUState *state, uint8_t db) {
-  state->a = state->a & db;
-  state->cc.s = sign(state->a);
-  state->cc.p = parity(state->a);
-  state->cc.z = state->a == 0;
-  state->cc.cy = 0;
-  state->cc.ac = 0;
-
-  state->pc += 2;
-}
-
-static inline void i8080_ora(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t reg = opcode & 7;
-  uint8_t db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-  } else {
-    db = *registers[reg];
-  }
-  state->a = state->a | db;
-  state->cc.s = sign(state->a);
-  state->cc.p = parity(state->a);
-  state->cc.z = state->a == 0;
-  state->cc.cy = 0;
-  state->cc.ac = 0;
-
-  state->pc += 1;
-}
-
-static inline void i8080_ori(CPUState *state, uint8_t db) {
-  state->a = state->a | db;
-  state->cc.s = sign(state->a);
-  state->cc.p = parity(state->a);
-  state->cc.z = state->a == 0;
-  state->cc.cy = 0;
-  state->cc.ac = 0;
-
-  state->pc += 2;
-}
-
-static inline void i8080_xra(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t reg = opcode & 7;
-  uint8_t db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-  } else {
-    db = *registers[reg];
-  }
-  state->a = state->a ^ db;
-  state->cc.s = sign(state->a);
-  state->cc.p = parity(state->a);
-  state->cc.z = state->a == 0;
-  state->cc.cy = 0;
-  state->cc.ac = 0;
-
-  state->pc += 1;
-}
-
-static inline void i8080_xri(CPUState *state, uint8_t db) {
-  state->a = state->a ^ db;
-  state->cc.s = sign(state->a);
-  state->cc.p = parity(state->a);
-  state->cc.z = state->a == 0;
-  state->cc.cy = 0;
-  state->cc.ac = 0;
-
-  state->pc += 2;
-}
-
-static inline void i8080_cmp(CPUState *state, uint8_t opcode,
-                             uint8_t *registers[]) {
-  uint8_t reg = opcode & 7;
-  uint8_t db;
-  if (reg == MEM_REGISTER) {
-    db = getMReg(state);
-  } else {
-    db = *registers[reg];
-  }
-  uint8_t val = state->a - db;
-  state->cc.s = sign(val);
-  state->cc.p = parity(val);
-  state->cc.z = state->a == db;
-  state->cc.cy = db > state->a;
-
-  state->pc += 1;
-}
-
-static inline void i8080_cpi(CPUState *state, uint8_t db) {
-  uint8_t val = state->a - db;
-  state->cc.s = sign(val);
-  state->cc.p = parity(val);
-  state->cc.z = state->a == db;
-  state->cc.cy = db > state->a;
-
-  state->pc += 2;
-}
-
-static inline void i8080_rlc(CPUState *state) {
-  uint16_t val = state->a << 1;
-  uint8_t cy = val >> 8;
-  assert(cy == 1);
-
-  // set first bit if wrap
-  state->a = (0xff & val) | cy;
-  state->cc.cy = cy;
-
-  state->pc += 1;
-}
-
-static inline void i8080_rrc(CPUState *state) {
-  uint8_t val = state->a >> 1;
-  uint8_t cy = state->a & 1;
-  assert((cy == 1) || (cy == 0));
-  // set 8th bit if wrap
-  state->a = val | (cy << 7);
-  state->cc.cy = cy;
-
-  state->pc += 1;
-}
-
-static inline void i8080_ral(CPUState *state) {
-  uint16_t val = state->a << 1;
-  uint8_t cy = (val >> 8) != 0;
-  // set first bit using prev carry
-  state->a = (0xff & val) | state->cc.cy;
-  state->cc.cy = cy;
-
-  state->pc += 1;
-}
-
-static inline void i8080_rar(CPUState *state) {
-  uint8_t val = state->a >> 1;
-  uint8_t cy = state->a & 1;
-  // set 8th bit if wrap
-  state->a = val | (state->cc.cy << 7);
-  state->cc.cy = cy;
-
-  state->pc += 1;
-}
-
-static inline void i8080_cma(CPUState *state) {
-  state->a = ~state->a;
-  state->pc += 1;
-}
-
-static inline void i8080_cmc(CPUState *state) {
-  state->cc.cy = ~state->cc.cy;
-  state->pc += 1;
-}
-
-static inline void i8080_stc(CPUState *state) {
-  state->cc.cy = 1;
-  state->pc += 1;
-}
-
-static inline void i8080_jmp(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t addr = get16Bit(hb, lb);
-  state->pc = addr;
-}
-
-static inline void i8080_jmp_cond(CPUState *state, uint8_t opcode, uint8_t hb,
-                                  uint8_t lb) {
-  uint8_t cond_flag = (opcode >> 3) & 7;
-  if (checkCond(state, cond_flag)) {
-    i8080_jmp(state, hb, lb);
-  } else {
-    state->pc += 3;
-  }
-}
-
-static inline void i8080_call(CPUState *state, uint8_t hb, uint8_t lb) {
-  uint16_t ret_addr = state->pc + 3;
-  state->memory[state->sp - 1] = ret_addr >> 8;
-  state->memory[state->sp - 2] = ret_addr & 0xff;
-  state->sp -= 2;
-
-  uint16_t subroutine_addr = get16Bit(hb, lb);
-  state->pc = subroutine_addr;
-}
-
-static inline void i8080_call_cond(CPUState *state, uint8_t opcode, uint8_t hb,
-                                   uint8_t lb) {
-  uint8_t cond_flag = (opcode >> 3) & 7;
-  if (checkCond(state, cond_flag)) {
-    i8080_call(state, hb, lb);
-  } else {
-    state->pc += 3;
-  }
-}
-
-static inline void i8080_ret(CPUState *state) {
-  uint8_t lb = state->memory[state->sp];
-  uint8_t hb = state->memory[state->sp + 1];
-  state->pc = get16Bit(hb, lb);
-  state->sp += 2;
-}
-
-static inline void i8080_ret_cond(CPUState *state, uint8_t opcode) {
-  uint8_t cond_flag = (opcode >> 3) & 7;
-  if (checkCond(state, cond_flag)) {
-    i8080_ret(state);
-  } else {
-    state->pc += 1;
+  state->pc += 3;
+  i8080_dcr(state, 0x3d, registers);
+  state->pc = loop;
+  return 1;
+}
+
+// A watch hit stops the debugger before the next instruction, so a pair
+// or triple whose memory access might hit one runs a part at a time
+static inline uint8_t watched(const CPUState *state, uint8_t kind,
+                              const uint8_t *code) {
+  uint16_t hl = get16Bit(state->h, state->l) & (MEMORY_SIZE - 1);
+  uint16_t de = get16Bit(state->d, state->e) & (MEMORY_SIZE - 1);
+  switch (kind) {
+  case FUSE_DCR_JNZ: // DCR M
+    return code[0] == 0x35 &&
+           (state->page_flags[hl >> 8] & (PAGE_WATCH_READ | PAGE_WATCH_WRITE));
+  case FUSE_MOV_A_M_INX_H:
+    return state->page_flags[hl >> 8] & PAGE_WATCH_READ;
+  case FUSE_LDAX_D_MOV_M_A_INX_H:
+    return (state->page_flags[de >> 8] & PAGE_WATCH_READ) ||
+           (state->page_flags[hl >> 8] & PAGE_WATCH_WRITE);
+  default:
+    return 0;
   }
 }
 
-static inline void i8080_rst(CPUState *state, uint8_t opcode) {
-  uint16_t ret_addr = state->pc + 1;
-  state->memory[state->sp - 1] = ret_addr >> 8;
-  state->memory[state->sp - 2] = ret_addr & 0xff;
-  state->sp -= 2;
-
-  uint8_t rst_num = (opcode >> 3) & 7;
-  uint16_t rst_addr = rst_num * 8;
-  state->pc = rst_addr;
-}
-
-static inline void i8080_pchl(CPUState *state) {
-  uint16_t addr = get16Bit(state->h, state->l);
-  state->pc = addr;
-}
-
-static inline void i8080_push(CPUState *state, uint8_t hr, uint8_t lr) {
-  state->memory[state->sp - 1] = hr;
-  state->memory[state->sp - 2] = lr;
-  state->sp -= 2;
-
-  state->pc += 1;
-}
-
-static inline void i8080_pop(CPUState *state, uint8_t *hr, uint8_t *lr) {
-  *lr = state->memory[state->sp];
-  *hr = state->memory[state->sp + 1];
-  state->sp += 2;
-
-  state->pc += 1;
-}
-
-static inline uint8_t make_psw_flag(const ConditionCodes *cc) {
-  assert((cc->cy == 1) || (cc->cy == 0));
-  uint8_t flag = cc->cy & 2;
-  flag &= cc->p << 2;
-  flag &= cc->ac << 4;
-  flag &= cc->z << 6;
-  flag &= cc->s << 7;
-  return flag;
-}
-
-static inline void i8080_push_psw(CPUState *state) {
-  state->memory[state->sp - 1] = state->a;
-  state->memory[state->sp - 2] = make_psw_flag(&state->cc);
-  state->sp -= 2;
-
-  state->pc += 1;
-}
-
-static inline void i8080_pop_psw(CPUState *state) {
-  uint8_t psw_flag = state->memory[state->sp];
-  state->cc.cy = psw_flag & 1;
-  state->cc.p = psw_flag & 4;
-  state->cc.z = psw_flag & 6;
-  state->cc.s = psw_flag & 7;
-
-  state->a = state->memory[state->sp + 1];
-  state->sp += 2;
-
-  state->pc += 1;
-}
-
-static inline void i8080_xthl(CPUState *state) {
-  uint8_t tmp = state->l;
-  state->l = state->memory[state->sp];
-  state->memory[state->sp] = tmp;
-  tmp = state->h;
-  state->h = state->memory[state->sp + 1];
-  state->memory[state->sp + 1] = tmp;
-
-  state->pc += 1;
-}
-
-static inline void i8080_ei(CPUState *state) {
-  state->int_enable = 1;
-  state->pc += 1;
-}
-
-static inline void i8080_di(CPUState *state) {
-  state->int_enable = 0;
-  state->pc += 1;
-}
-
-static inline void i8080_sphl(CPUState *state) {
-  state->sp = get16Bit(state->h, state->l);
-  state->pc += 1;
-}
-
-static inline void i8080_in(CPUState *state,uint8_t port){
-
-}
-
-static inline void i8080_out(CPUState *state, uint8_t port){
-
-}
+// Instructions in each pair and triple; loops budget their own iterations
+static const uint8_t fused_parts[FUSE_COUNT] = {
+    [FUSE_DCR_JNZ] = 2,
+    [FUSE_MOV_A_M_INX_H] = 2,
+    [FUSE_LDAX_D_MOV_M_A_INX_H] = 3,
+    [FUSE_CPI_JZ] = 2,
+    [FUSE_CPI_JNZ] = 2,
+};
 
-static inline void i8080_halt(CPUState *state, uint8_t port){
-
-}
-
-void handleOpcode(CPUState *state, uint8_t *registers[]) {
+// Executes the superinstruction predecoded at pc. Each part goes through the
+// same helper as its unfused opcode, in program order, so registers, flags
+// and memory end up exactly as if the instructions were dispatched one by one.
+void handleFusedOpcode(CPUState *state, uint8_t kind, uint8_t *registers[]) {
   uint8_t *code = &state->memory[state->pc];
-
-  switch (code[0]) {
-  // LDA
-  case 0x3a:
-    i8080_lda(state, code[2], code[1]);
-    break;
-  // STA
-  case 0x32:
-    i8080_sta(state, code[2], code[1]);
-    break;
-  // LHLD
-  case 0x2a:
-    i8080_lhld(state, code[2], code[1]);
-    break;
-  // SHLD
-  case 0x22:
-    i8080_shld(state, code[2], code[1]);
-    break;
-  // XCHG
-  case 0xeb:
-    i8080_xchg(state);
-    break;
-  // ADI
-  case 0xc6:
-    i8080_adi(state, code[1], 0);
-    break;
-  // ACI
-  case 0xce:
-    i8080_adi(state, code[1], state->cc.cy);
-    break;
-  // SUI
-  case 0xd6:
-    i8080_sui(state, code[1], 0);
-    break;
-  // SBI
-  case 0xde:
-    i8080_sui(state, code[1], state->cc.cy);
-    break;
-  // DAA
-  case 0x27:
-    i8080_daa(state);
-    break;
-  // STC
-  case 0x37:
-    i8080_stc(state);
-    break;
-  // ANI
-  case 0xe6:
-    i8080_ani(state, code[1]);
-    break;
-  // ORI
-  case 0xf6:
-    i8080_ori(state, code[1]);
-    break;
-  // XRI
-  case 0xee:
-    i8080_xri(state, code[1]);
-    break;
-  // RLC
-  case 0x07:
-    i8080_rlc(state);
-    break;
-  // RRC
-  case 0x0f:
-    i8080_rrc(state);
-    break;
-  // RAL
-  case 0x17:
-    i8080_ral(state);
-    break;
-  // RAR
-  case 0x1f:
-    i8080_rar(state);
-    break;
-  // CMA
-  case 0x2f:
-    i8080_cma(state);
-    break;
-  // CMC
-  case 0x3f:
-    i8080_cmc(state);
-    break;
-  // JMP
-  case 0xc3:
-    i8080_jmp(state, code[2], code[1]);
-    break;
-  // CALL
-  case 0xcd:
-    i8080_call(state, code[2], code[1]);
-    break;
-  // RET
-  case 0xc9:
-    i8080_ret(state);
-    break;
-  // PCHL
-  case 0xe9:
-    i8080_pchl(state);
-    break;
-  // XTHL
-  case 0xe3:
-    i8080_xthl(state);
-    break;
-  // SPHL
-  case 0xf9:
-      i8080_sphl(state);
-    break;
-  // EI
-  case 0xfb:
-      i8080_ei(state);
-    break;
-  // DI
-  case 0xf3:
-      i8080_di(state);
-    break;
-  // HLT
-  case 0x76:
-    printf("HLT");
-    break;
-  // IN
-  case 0xdb:
-    printf("IN");
-    break;
-  // OUT
-  case 0xd3:
-    printf("OUT");
-    break;
-  // CPI
-  case 0xfe:
-    i8080_cpi(state, code[1]);
-    break;
-
-  // MOV
-  case 0x40 ... 0x75:
-  case 0x77 ... 0x7f:
-    i8080_mov(state, code[0], registers);
-    break;
-
-  // MVI
-  case 0x06:
-  case 0x0e:
-  case 0x16:
-  case 0x1e:
-  case 0x26:
-  case 0x2e:
-  case 0x36:
-  case 0x3e:
-    i8080_mvi(state, code[0], code[1], registers);
-    break;
-
-  // LXI
-  case 0x01: // bc
-    i8080_lxi(state, &state->b, &state->c, code[2], code[1]);
-    break;
-  case 0x11: // de
-    i8080_lxi(state, &state->d, &state->e, code[2], code[1]);
-    break;
-  case 0x21: // hl
-    i8080_lxi(state, &state->h, &state->l, code[2], code[1]);
-    break;
-  case 0x31: // sp
-    i8080_lxi_sp(state, code[2], code[1]);
-    break;
-
-  // STAX
-  case 0x02:
-    i8080_stax(state, state->b, state->c);
-    break;
-  case 0x12:
-    i8080_stax(state, state->d, state->e);
-    break;
-
-  // LDAX
-  case 0x0a:
-    i8080_ldax(state, state->b, state->c);
-  case 0x1a:
-    i8080_ldax(state, state->d, state->e);
-    break;
-
-  // ADD
-  case 0x80 ... 0x87: {
-    i8080_add(state, code[0], registers, 0);
-    break;
+  // the parts retire together, so when a device event falls due before the
+  // last one, the first runs on its own and the event lands where it would
+  int parts = fused_parts[kind];
+  uint32_t cycles = parts ? sequenceCycles(code, parts) : 0;
+  if (parts && ((state->next_event &&
+                  state->cycles + cycles > state->next_event) ||
+                 watched(state, kind, code))) {
+    handleOpcode(state, registers);
+    return;
   }
 
-  // ADC
-  case 0x88 ... 0x8f: {
-    i8080_add(state, code[0], registers, state->cc.cy);
-    break;
-  }
-
-  // SUB
-  case 0x90 ... 0x97:
-    i8080_sub(state, code[0], registers, 0);
-    break;
-
-  // SBB
-  case 0x98 ... 0x9f:
-    i8080_sub(state, code[0], registers, state->cc.cy);
-    break;
-
-  // ANA
-  case 0xa0 ... 0xa7:
-    i8080_ana(state, code[0], registers);
-    break;
-
-  // XRA
-  case 0xa8 ... 0xaf:
-    i8080_xra(state, code[0], registers);
-    break;
-
-  // ORA
-  case 0xb0 ... 0xb7:
-    i8080_ora(state, code[0], registers);
-    break;
-
-  // CMP
-  case 0xb8 ... 0xbf:
-    i8080_cmp(state, code[0], registers);
-    break;
-
-    // INR
-  case 0x04:
-  case 0x0c:
-  case 0x14:
-  case 0x1c:
-  case 0x24:
-  case 0x2c:
-  case 0x34:
-  case 0x3c:
-    i8080_inr(state, code[0], registers);
-    break;
-
-  // DCR
-  case 0x05:
-  case 0x0d:
-  case 0x15:
-  case 0x1d:
-  case 0x25:
-  case 0x2d:
-  case 0x35:
-  case 0x3d:
+  switch (kind) {
+  case FUSE_DCR_JNZ:
+    state->cycles += cycles;
+    state->instructions += parts;
     i8080_dcr(state, code[0], registers);
+    if (state->cc.z == 0) {
+      i8080_jmp(state, code[3], code[2]);
+    } else {
+      state->pc += 3;
+    }
     break;
 
-  // INX
-  case 0x03:
-    i8080_inx(state, &state->b, &state->c);
-    break;
-  case 0x13:
-    i8080_inx(state, &state->d, &state->e);
-    break;
-  case 0x23:
+  case FUSE_MOV_A_M_INX_H:
+    state->cycles += cycles;
+    state->instructions += parts;
+    i8080_mov(state, 0x7e, registers);
     i8080_inx(state, &state->h, &state->l);
     break;
-  case 0x33:
-    state->sp += 1;
-    state->pc += 1;
-    break;
 
-  // DCX
-  case 0x0b:
-    i8080_dcx(state, &state->b, &state->c);
-    break;
-  case 0x1b:
-    i8080_dcx(state, &state->d, &state->e);
-    break;
-  case 0x2b:
-    i8080_dcx(state, &state->h, &state->l);
-    break;
-  case 0x3b:
-    state->sp -= 1;
-    state->pc += 1;
-    break;
-
-  // DAD
-  case 0x09:
-    i8080_dad(state, state->b, state->c);
-    break;
-  case 0x19:
-    i8080_dad(state, state->b, state->c);
-    break;
-
-  case 0x29:
-    i8080_dad(state, state->h, state->l);
-    break;
-  case 0x39: {
-    i8080_dad(state, state->sp >> 8, state->sp & 0xff);
-    break;
-  }
-
-  // JMP conditional
-  case 0xc2: // JNZ
-  case 0xca: // JZ
-  case 0xd2: // JNC
-  case 0xda: // JC
-  case 0xe2: // JPO
-  case 0xea: // JPE
-  case 0xf2: // JP
-  case 0xfa: // JM
-    i8080_jmp_cond(state, code[0], code[2], code[1]);
-    break;
-
-  // Cccc
-  case 0xc4: // CNZ
-  case 0xcc: // CZ
-  case 0xd4: // CNC
-  case 0xdc: // CC
-  case 0xe4: // CPO
-  case 0xec: // CPE
-  case 0xf4: // CP
-  case 0xfc: // CM
-    i8080_call_cond(state, code[0], code[2], code[1]);
-    break;
-
-  // Rccc
-  case 0xc0: // RNZ
-  case 0xc8: // RZ
-  case 0xd0: // RNC
-  case 0xd8: // RC
-  case 0xe0: // RPO
-  case 0xe8: // RPE
-  case 0xf0: // RP
-  case 0xf8: // RM
-    i8080_ret_cond(state, code[0]);
-    break;
-
-  // RST n
-  case 0xc7:
-  case 0xcf:
-  case 0xd7:
-  case 0xdf:
-  case 0xe7:
-  case 0xef:
-  case 0xf7:
-  case 0xff:
-    i8080_rst(state, code[0]);
+  case FUSE_LDAX_D_MOV_M_A_INX_H:
+    state->cycles += cycles;
+    state->instructions += parts;
+    i8080_ldax(state, state->d, state->e);
+    i8080_mov(state, 0x77, registers);
+    i8080_inx(state, &state->h, &state->l);
     break;
 
-  // PUSH
-  case 0xc5:
-    i8080_push(state, state->b, state->c);
-    break;
-  case 0xd5:
-    i8080_push(state, state->d, state->e);
-    break;
-  case 0xe5:
-    i8080_push(state, state->h, state->l);
+  // CPI leaves the flags the jump tests, so they are visible to the target
+  case FUSE_CPI_JZ:
+    state->cycles += cycles;
+    state->instructions += parts;
+    i8080_cpi(state, code[1]);
+    if (state->cc.z == 1) {
+      i8080_jmp(state, code[4], code[3]);
+    } else {
+      state->pc += 3;
+    }
     break;
-
-  // PUSH PSW
-  case 0xf5:
-    i8080_push_psw(state);
+  case FUSE_CPI_JNZ:
+    state->cycles += cycles;
+    state->instructions += parts;
+    i8080_cpi(state, code[1]);
+    if (state->cc.z == 0) {
+      i8080_jmp(state, code[4], code[3]);
+    } else {
+      state->pc += 3;
+    }
     break;
 
-  // POP
-  case 0xc1:
-    i8080_pop(state, &state->b, &state->c);
+  case FUSE_LOOP_COPY:
+    if (!i8080_loop_copy(state, code, registers))
+      handleOpcode(state, registers);
     break;
-  case 0xd1:
-    i8080_pop(state, &state->d, &state->e);
+  case FUSE_LOOP_FILL:
+    if (!i8080_loop_fill(state, code, registers))
+      handleOpcode(state, registers);
     break;
-  case 0xe1:
-    i8080_pop(state, &state->h, &state->l);
+  case FUSE_LOOP_CLEAR:
+    if (!i8080_loop_clear(state, code))
+      handleOpcode(state, registers);
     break;
-
-  // POP PSW
-  case 0xf1:
-    i8080_pop_psw(state);
-    break;
-
-  // NOP
-  case 0x00:
-  case 0x08:
-  case 0x10:
-  case 0x18:
-  case 0x20:
-  case 0x28:
-  case 0x30:
-  case 0x38:
-  case 0xcb:
-  case 0xd9:
-  case 0xdd:
-  case 0xed:
-  case 0xfd:
-    // printf("NOP");
+  case FUSE_LOOP_WAIT:
+    if (!i8080_loop_wait(state, code, registers))
+      handleOpcode(state, registers);
     break;
 
   default:
-    unimplementedOpcodeError(code[0]);
+    handleOpcode(state, registers);
     break;
   }
 }
 
-int main(int argc, char *argv[]) {
-  FILE *f = fopen(argv[1], "rb");
-
-  if (f == NULL) {
-    printf("error: Couldn't open file %s\n", argv[1]);
-    exit(1);
-  }
-
-  CPUState cpu_state;
-  cpu_state.memory = (uint8_t *)malloc(MEMORY_SIZE);
-  cpu_state.pc = PROGRAM_START;
-
-  uint8_t *registers[8];
-  registers[0] = &cpu_state.b;
-  registers[1] = &cpu_state.c;
-  registers[2] = &cpu_state.d;
-  registers[3] = &cpu_state.e;
-  registers[4] = &cpu_state.h;
-  registers[5] = &cpu_state.l;
-  registers[6] = NULL; // mem reg
-  registers[7] = &cpu_state.a;
-
-  fseek(f, 0, SEEK_END);
-  int fsize = ftell(f);
-  fseek(f, 0, SEEK_SET);
-
-  fread(cpu_state.memory, fsize, 1, f);
-  fclose(f);
-
-  while (cpu_state.pc < fsize) {
-    handleOpcode(&cpu_state, registers);
-  }
-  return 0;
-}
@@ -12,6 +12,12 @@ typedef struct {
   uint8_t pad : 3;
 } ConditionCodes;
 
+struct Debugger;
+
+// I/O port hooks, called with CPUState.port_ctx
+typedef uint8_t (*PortIn)(void *ctx, uint8_t port);
+typedef void (*PortOut)(void *ctx, uint8_t port, uint8_t value);
+
 typedef struct {
   uint8_t a;
   uint8_t b;
@@ -25,10 +31,26 @@ typedef struct {
   uint8_t *memory;
   ConditionCodes cc;
   uint8_t int_enable;
+  uint64_t cycles;       // clock states since reset
+  uint64_t instructions; // instructions retired since reset
+  // clock state the next device event (an interrupt) falls on, 0 if none;
+  // superinstructions and collapsed loops stop short of it (fusion.h)
+  uint64_t next_event;
+  // PAGE_* bits per 256-byte page; data accesses to a flagged page take the
+  // slow path in memRead/memWrite
+  uint8_t page_flags[0x100];
+  // nonzero for each 256-byte page stored to since the last snapshot
+  // (snapshot.h); set by memWrite and by anything that writes around it
+  uint8_t dirty[0x100];
+  struct Debugger *debugger; // owns the PAGE_WATCH_* bits, may be NULL
+  PortIn port_in;            // NULL reads 0
+  PortOut port_out;          // NULL discards
+  void *port_ctx;
 } CPUState;
 
 
 void handleOpcode(CPUState *state, uint8_t *registers[]);
+void handleFusedOpcode(CPUState *state, uint8_t kind, uint8_t *registers[]);
 
 
 #define MEMORY_SIZE 0x4000
@@ -39,4 +61,10 @@ void handleOpcode(CPUState *state, uint8_t *registers[]);
 
 #define MEM_REGISTER 6
 
+#define PAGE_WATCH_READ 0x01
+#define PAGE_WATCH_WRITE 0x02
+// the board's ROM (invaders.h), mapped read-only when shared (arena.h);
+// stores are dropped as on the real board
+#define PAGE_ROM 0x04
+
 #endif
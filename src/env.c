@@ -0,0 +1,302 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef EMBEDDED_ROM
+#include "embedded.h"
+#endif
+#include "env.h"
+#include "fusion.h"
+#include "invaders.h"
+#include "snapshot.h"
+
+// bit 3 of port 1 is wired high, bit 7 is unused
+#define PORT1_MASK 0x77
+// Machines claimed per grab from the shared counter
+#define CHUNK 4
+
+// Lives in the batch's arena; its memory is an arena address space. Data
+// accesses are masked into it (memRead/memWrite), but the spaces sit back
+// to back, so invadersRunFrame ends a run before fetching an instruction
+// that would run past the end.
+typedef struct Env {
+  CPUState cpu;
+  InvadersBoard board;
+  uint8_t *registers[8];
+  uint32_t frames; // since the last restart
+  uint16_t score;
+  uint8_t playing;
+  uint8_t restart; // reported done, restarts on the next step
+} Env;
+
+typedef struct EnvPool {
+  pthread_t *threads;
+  int n_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t finished;
+  uint64_t generation; // one per env_batch_step that uses the workers
+  int busy;            // workers still on the current generation
+  int quit;
+  _Atomic int next; // first machine not yet claimed
+  EnvBatch *batch;
+  const uint8_t *actions;
+  int n;
+} EnvPool;
+
+static Env *newEnv(Arena *arena) {
+  uint8_t *memory;
+  Env *env = arenaAlloc(arena, &memory);
+  if (env == NULL)
+    return NULL;
+  env->registers[0] = &env->cpu.b;
+  env->registers[1] = &env->cpu.c;
+  env->registers[2] = &env->cpu.d;
+  env->registers[3] = &env->cpu.e;
+  env->registers[4] = &env->cpu.h;
+  env->registers[5] = &env->cpu.l;
+  env->registers[6] = NULL; // mem reg
+  env->registers[7] = &env->cpu.a;
+  arenaWire(arena, &env->cpu, memory);
+  invadersInit(&env->board, &env->cpu);
+  return env;
+}
+
+// Video RAM at 0x2400 holds the screen rotated a quarter turn: 224 columns
+// of 32 bytes, each byte eight pixels going up from the bottom
+static void render(const uint8_t *memory, uint8_t *out) {
+  static const uint8_t level[5] = {0, 64, 128, 192, 255};
+  const uint8_t *vram = &memory[0x2400];
+  for (int x = 0; x < ENV_WIDTH; x++) {
+    const uint8_t *left = &vram[x * 64];
+    const uint8_t *right = left + 32;
+    for (int b = 0; b < 32; b++) {
+      for (int k = 0; k < 4; k++) {
+        int lit = __builtin_popcount((left[b] >> (k * 2)) & 3) +
+                  __builtin_popcount((right[b] >> (k * 2)) & 3);
+        out[(ENV_HEIGHT - 1 - b * 4 - k) * ENV_WIDTH + x] = level[lit];
+      }
+    }
+  }
+}
+
+static inline int bcd(uint8_t v) { return (v >> 4) * 10 + (v & 0xf); }
+
+static uint16_t readScore(const uint8_t *memory) {
+  return bcd(memory[ENV_SCORE_ADDR + 1]) * 100 + bcd(memory[ENV_SCORE_ADDR]);
+}
+
+static void restartEnv(EnvBatch *envs, Env *env) {
+  snapshotRestore(&envs->start, &env->cpu, &env->board);
+  env->frames = 0;
+  env->score = readScore(env->cpu.memory);
+  env->playing = env->cpu.memory[ENV_GAME_MODE_ADDR];
+  env->restart = 0;
+}
+
+static void stepEnv(EnvBatch *envs, int i, uint8_t action) {
+  Env *env = envs->envs[i];
+  if (env->restart)
+    restartEnv(envs, env);
+
+  env->board.port1 = action & PORT1_MASK;
+  int alive = invadersRunFrame(&env->board, &env->cpu, env->registers,
+                               envs->kinds, NULL);
+  env->frames++;
+
+  // the score goes back to 0 when a new game starts
+  uint16_t score = readScore(env->cpu.memory);
+  envs->rewards[i] = score > env->score ? score - env->score : 0;
+  env->score = score;
+
+  uint8_t playing = env->cpu.memory[ENV_GAME_MODE_ADDR];
+  int game_over = env->playing && !playing;
+  env->playing = playing;
+
+  envs->dones[i] = !alive || game_over ||
+                   (envs->max_frames && env->frames >= envs->max_frames);
+  env->restart = envs->dones[i];
+  render(env->cpu.memory, &envs->frames[(size_t)i * ENV_FRAME_SIZE]);
+}
+
+static void work(EnvPool *pool) {
+  int i;
+  while ((i = atomic_fetch_add(&pool->next, CHUNK)) < pool->n) {
+    int end = i + CHUNK < pool->n ? i + CHUNK : pool->n;
+    for (; i < end; i++) {
+      stepEnv(pool->batch, i, pool->actions[i]);
+    }
+  }
+}
+
+static void *worker(void *arg) {
+  EnvPool *pool = arg;
+  uint64_t seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (pool->generation == seen && !pool->quit) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->quit)
+      break;
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0)
+      pthread_cond_signal(&pool->finished);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+EnvBatch *env_batch_create(const uint8_t *rom, size_t rom_size, int n,
+                           int threads, uint32_t max_frames) {
+#ifdef EMBEDDED_ROM
+  if (rom == NULL) {
+    rom = embeddedBoot.memory;
+    rom_size = embeddedRomSize;
+  }
+#endif
+  if (rom == NULL || rom_size > ROM_SIZE || n < 1 || threads < 0)
+    return NULL;
+
+  EnvBatch *envs = calloc(1, sizeof(EnvBatch));
+  if (envs == NULL)
+    return NULL;
+  if (!arenaInit(&envs->arena, n, sizeof(Env), rom, rom_size)) {
+    free(envs);
+    return NULL;
+  }
+  envs->n = n;
+  envs->max_frames = max_frames;
+  envs->frames = malloc((size_t)n * ENV_FRAME_SIZE);
+  envs->rewards = calloc(n, sizeof(int32_t));
+  envs->dones = calloc(n, 1);
+  envs->envs = calloc(n, sizeof(Env *));
+  envs->kinds = calloc(ARENA_SPACE, 1);
+  envs->pool = calloc(1, sizeof(EnvPool));
+  if (envs->frames == NULL || envs->rewards == NULL || envs->dones == NULL ||
+      envs->envs == NULL || envs->kinds == NULL || envs->pool == NULL) {
+    env_batch_destroy(envs);
+    return NULL;
+  }
+  for (int i = 0; i < n; i++) {
+    envs->envs[i] = newEnv(&envs->arena);
+    if (envs->envs[i] == NULL) {
+      env_batch_destroy(envs);
+      return NULL;
+    }
+  }
+  fusionPredecode(rom, rom_size, envs->kinds);
+
+  // boot one machine and copy it to the rest
+  Env *first = envs->envs[0];
+#ifdef EMBEDDED_ROM
+  if (rom == embeddedBoot.memory)
+    snapshotClone(&embeddedBoot, &first->cpu, &first->board);
+  else
+#endif
+  {
+    first->cpu.pc = PROGRAM_START;
+    for (int frame = 0; frame < ENV_BOOT_FRAMES; frame++) {
+      invadersRunFrame(&first->board, &first->cpu, first->registers,
+                       envs->kinds, NULL);
+    }
+  }
+  snapshotTake(&envs->start, &first->cpu, ARENA_SPACE, &first->board,
+               sizeof(InvadersBoard));
+  for (int i = 1; i < n; i++) {
+    snapshotClone(&envs->start, &envs->envs[i]->cpu, &envs->envs[i]->board);
+  }
+
+  // env_batch_destroy only tears the pool down once threads is set
+  EnvPool *pool = envs->pool;
+  pool->batch = envs;
+  pthread_t *pool_threads = calloc(threads ? threads : 1, sizeof(pthread_t));
+  if (pool_threads == NULL) {
+    env_batch_destroy(envs);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->finished, NULL);
+  pool->threads = pool_threads;
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0)
+      break;
+    pool->n_threads++;
+  }
+
+  env_batch_reset(envs);
+  return envs;
+}
+
+void env_batch_destroy(EnvBatch *envs) {
+  EnvPool *pool = envs->pool;
+  if (pool != NULL && pool->threads != NULL) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->n_threads; i++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->finished);
+    free(pool->threads);
+  }
+  free(pool);
+  snapshotFree(&envs->start);
+  arenaDestroy(&envs->arena);
+  free(envs->envs);
+  free(envs->kinds);
+  free(envs->frames);
+  free(envs->rewards);
+  free(envs->dones);
+  free(envs);
+}
+
+void env_batch_reset(EnvBatch *envs) {
+  for (int i = 0; i < envs->n; i++) {
+    restartEnv(envs, envs->envs[i]);
+    envs->rewards[i] = 0;
+    envs->dones[i] = 0;
+    render(envs->envs[i]->cpu.memory,
+           &envs->frames[(size_t)i * ENV_FRAME_SIZE]);
+  }
+}
+
+int env_batch_step(EnvBatch *envs, const uint8_t *actions, int n) {
+  if (n > envs->n)
+    return -1;
+
+  EnvPool *pool = envs->pool;
+  pool->actions = actions;
+  pool->n = n;
+  atomic_store(&pool->next, 0);
+  // one wakeup per call; a batch the caller can finish alone stays put
+  if (pool->n_threads == 0 || n <= CHUNK) {
+    work(pool);
+    return 0;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->busy = pool->n_threads;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  work(pool);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0) {
+    pthread_cond_wait(&pool->finished, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return 0;
+}
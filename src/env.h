@@ -0,0 +1,68 @@
+#ifndef ENV_H
+#define ENV_H
+
+// Batched environment for agents playing the Invaders ROM. A batch owns N
+// independent machines; env_batch_step applies one action per machine,
+// runs each for one frame on a persistent thread pool and fills the
+// batch's preallocated output arrays in place. Nothing is allocated, and
+// the workers are woken once per call, not once per machine.
+//
+// An action is the port 1 buttons held for the frame (INVADERS_COIN,
+// INVADERS_P1_START, INVADERS_P1_SHOT, INVADERS_P1_LEFT, ...). Machines
+// start in attract mode after ENV_BOOT_FRAMES; the agent inserts the coin
+// and presses start itself.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "invaders.h"
+#include "snapshot.h"
+
+// The upright 224x256 screen averaged over 2x2 blocks: 0, 64, 128, 192 or
+// 255 by how many of the four pixels are lit
+#define ENV_WIDTH 112
+#define ENV_HEIGHT 128
+#define ENV_FRAME_SIZE (ENV_WIDTH * ENV_HEIGHT)
+
+#define ENV_BOOT_FRAMES INVADERS_BOOT_FRAMES
+
+// Player 1 score, four BCD digits, low byte first
+#define ENV_SCORE_ADDR 0x20f8
+// 1 while a game is in progress, 0 in attract mode
+#define ENV_GAME_MODE_ADDR INVADERS_GAME_MODE
+
+struct Env;
+struct EnvPool;
+
+typedef struct {
+  int n;
+  uint8_t *frames;  // n * ENV_FRAME_SIZE, row by row from the top
+  int32_t *rewards; // score gained this step
+  uint8_t *dones;   // game over, frame limit reached or pc ran off memory
+  uint32_t max_frames; // 0 for no limit
+  struct Env **envs;
+  Arena arena;    // the machines, sharing one copy of the ROM
+  Snapshot start; // post-boot machine every one restarts from
+  uint8_t *kinds; // superinstructions of the ROM, shared
+  struct EnvPool *pool;
+} EnvBatch;
+
+// n machines running rom, stepped by threads workers plus the caller
+// (0 steps everything on the calling thread). In an EMBED_ROM build a NULL
+// rom starts them from the embedded post-boot state instead of booting.
+// Returns NULL if the ROM is larger than ROM_SIZE (or missing) or
+// allocation fails.
+EnvBatch *env_batch_create(const uint8_t *rom, size_t rom_size, int n,
+                           int threads, uint32_t max_frames);
+void env_batch_destroy(EnvBatch *envs);
+
+// Puts every machine back at the post-boot state and renders its frame
+void env_batch_reset(EnvBatch *envs);
+
+// Steps the first n machines one frame with actions[i]. A machine that
+// reported done restarts from the post-boot state on its next step.
+// Returns -1 if n is larger than the batch.
+int env_batch_step(EnvBatch *envs, const uint8_t *actions, int n);
+
+#endif
@@ -0,0 +1,137 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "fusion.h"
+
+static inline int isDcr(uint8_t op) { return (op & 0xc7) == 0x05; }
+
+static inline int jumpsTo(const uint8_t *operand, size_t addr) {
+  return operand[0] == (addr & 0xff) && operand[1] == (addr >> 8);
+}
+
+static uint8_t matchLoop(const uint8_t *code, size_t avail, size_t addr) {
+  // LDAX D ; MOV M,A ; INX H ; INX D ; DCR B ; JNZ loop
+  if (avail >= 8 && code[0] == 0x1a && code[1] == 0x77 && code[2] == 0x23 &&
+      code[3] == 0x13 && code[4] == 0x05 && code[5] == 0xc2 &&
+      jumpsTo(&code[6], addr))
+    return FUSE_LOOP_COPY;
+
+  // MOV M,A ; INX H ; DCR B ; JNZ loop
+  if (avail >= 6 && code[0] == 0x77 && code[1] == 0x23 && code[2] == 0x05 &&
+      code[3] == 0xc2 && jumpsTo(&code[4], addr))
+    return FUSE_LOOP_FILL;
+
+  // MVI M,d8 ; INX H ; MOV A,H ; CPI d8 ; JNZ loop
+  if (avail >= 10 && code[0] == 0x36 && code[2] == 0x23 && code[3] == 0x7c &&
+      code[4] == 0xfe && code[6] == 0xc2 && jumpsTo(&code[7], addr))
+    return FUSE_LOOP_CLEAR;
+
+  // LDA a16 ; DCR A ; JNZ loop
+  if (avail >= 7 && code[0] == 0x3a && code[3] == 0x3d && code[4] == 0xc2 &&
+      jumpsTo(&code[5], addr))
+    return FUSE_LOOP_WAIT;
+
+  return FUSE_NONE;
+}
+
+static uint8_t matchFusion(const uint8_t *code, size_t avail, size_t addr) {
+  uint8_t loop = matchLoop(code, avail, addr);
+  if (loop != FUSE_NONE)
+    return loop;
+
+  // DCR r ; JNZ a16
+  if (avail >= 4 && isDcr(code[0]) && code[1] == 0xc2)
+    return FUSE_DCR_JNZ;
+
+  // LDAX D ; MOV M,A ; INX H
+  if (avail >= 3 && code[0] == 0x1a && code[1] == 0x77 && code[2] == 0x23)
+    return FUSE_LDAX_D_MOV_M_A_INX_H;
+
+  // MOV A,M ; INX H
+  if (avail >= 2 && code[0] == 0x7e && code[1] == 0x23)
+    return FUSE_MOV_A_M_INX_H;
+
+  // CPI d8 ; JZ a16 / JNZ a16
+  if (avail >= 5 && code[0] == 0xfe) {
+    if (code[2] == 0xca)
+      return FUSE_CPI_JZ;
+    if (code[2] == 0xc2)
+      return FUSE_CPI_JNZ;
+  }
+
+  return FUSE_NONE;
+}
+
+void fusionPredecode(const uint8_t *memory, size_t size, uint8_t *kinds) {
+  // every address is scanned, not just reachable instruction starts: the
+  // kind is only consulted when pc lands there, so data bytes that happen to
+  // match a pattern are harmless
+  for (size_t addr = 0; addr < size; addr++) {
+    kinds[addr] = matchFusion(&memory[addr], size - addr, addr);
+  }
+}
+
+const char *fusionName(uint8_t kind) {
+  switch (kind) {
+  case FUSE_DCR_JNZ:
+    return "DCR r; JNZ";
+  case FUSE_MOV_A_M_INX_H:
+    return "MOV A,M; INX H";
+  case FUSE_LDAX_D_MOV_M_A_INX_H:
+    return "LDAX D; MOV M,A; INX H";
+  case FUSE_CPI_JZ:
+    return "CPI; JZ";
+  case FUSE_CPI_JNZ:
+    return "CPI; JNZ";
+  case FUSE_LOOP_COPY:
+    return "block copy loop";
+  case FUSE_LOOP_FILL:
+    return "block fill loop";
+  case FUSE_LOOP_CLEAR:
+    return "clear to page loop";
+  case FUSE_LOOP_WAIT:
+    return "wait loop";
+  case FUSE_BREAK:
+    return "debugger stop";
+  default:
+    return "none";
+  }
+}
+
+int fusionLength(uint8_t kind) {
+  switch (kind) {
+  case FUSE_DCR_JNZ:
+    return 4;
+  case FUSE_MOV_A_M_INX_H:
+    return 2;
+  case FUSE_LDAX_D_MOV_M_A_INX_H:
+    return 3;
+  case FUSE_CPI_JZ:
+  case FUSE_CPI_JNZ:
+    return 5;
+  case FUSE_LOOP_COPY:
+    return 8;
+  case FUSE_LOOP_FILL:
+    return 6;
+  case FUSE_LOOP_CLEAR:
+    return 10;
+  case FUSE_LOOP_WAIT:
+    return 7;
+  default:
+    return 0;
+  }
+}
+
+void fusionPrintStats(const FusionStats *stats) {
+  uint64_t fused = 0;
+  for (int kind = FUSE_NONE + 1; kind < FUSE_BREAK; kind++) {
+    fused += stats->hits[kind];
+  }
+
+  printf("fusion: %" PRIu64 " of %" PRIu64 " dispatches fused (%.2f%%)\n",
+         fused, stats->dispatches,
+         stats->dispatches ? 100.0 * fused / stats->dispatches : 0.0);
+  for (int kind = FUSE_NONE + 1; kind < FUSE_COUNT; kind++) {
+    printf("  %-24s %12" PRIu64 "\n", fusionName(kind), stats->hits[kind]);
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Superinstructions: common opcode pairs/triples executed by one handler,
+// plus whole block copy/fill loops executed as one memcpy/memset. Kinds are
+// recorded per ROM address by fusionPredecode and dispatched by
+// handleFusedOpcode in emu.c.
+enum {
+  FUSE_NONE = 0,
+  FUSE_DCR_JNZ,              // DCR r ; JNZ a16
+  FUSE_MOV_A_M_INX_H,        // MOV A,M ; INX H
+  FUSE_LDAX_D_MOV_M_A_INX_H, // LDAX D ; MOV M,A ; INX H
+  FUSE_CPI_JZ,               // CPI d8 ; JZ a16
+  FUSE_CPI_JNZ,              // CPI d8 ; JNZ a16
+  // loops, the JNZ targets the first instruction of the pattern
+  FUSE_LOOP_COPY,  // LDAX D ; MOV M,A ; INX H ; INX D ; DCR B ; JNZ loop
+  FUSE_LOOP_FILL,  // MOV M,A ; INX H ; DCR B ; JNZ loop
+  FUSE_LOOP_CLEAR, // MVI M,d8 ; INX H ; MOV A,H ; CPI d8 ; JNZ loop
+  FUSE_LOOP_WAIT,  // LDA a16 ; DCR A ; JNZ loop, spinning until an interrupt
+  // not a superinstruction: the debugger patches it over the kind at a
+  // breakpoint so the run loop stops there at no cost elsewhere (debug.h)
+  FUSE_BREAK,
+  FUSE_COUNT
+};
+
+typedef struct {
+  uint64_t dispatches;       // every handleOpcode/handleFusedOpcode call
+  uint64_t hits[FUSE_COUNT]; // dispatches per kind, FUSE_NONE is unfused
+} FusionStats;
+
+// Scans size bytes of memory and stores the fusion kind starting at each
+// address in kinds (FUSE_NONE where nothing matches). Only meaningful for
+// memory the program does not write, i.e. the ROM.
+void fusionPredecode(const uint8_t *memory, size_t size, uint8_t *kinds);
+
+const char *fusionName(uint8_t kind);
+// Bytes of code the superinstruction covers, 0 for FUSE_NONE and FUSE_BREAK
+int fusionLength(uint8_t kind);
+
+void fusionPrintStats(const FusionStats *stats);
+
+#endif
@@ -0,0 +1,545 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "gdbstub.h"
+#include "timeline.h"
+#include "trace.h"
+
+#define PACKET_MAX 4096
+
+// What gdb told a parked run loop to do
+enum { RESUME_NONE, RESUME_CONTINUE, RESUME_STEP, RESUME_QUIT };
+
+struct GdbStub {
+  CPUState *state;
+  Debugger *debugger;
+  int listen_fd;
+  int fd;       // the connection, -1 while nobody is attached
+  int event_fd; // run loop -> stub: stopped
+  char path[108];
+  pthread_t thread;
+  _Atomic int interrupt;
+  _Atomic int closing;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // under lock
+  int stopped; // run loop parked, the stub owns the CPU
+  int reason;
+  int resume;
+  int awaiting_stop; // a stop reply is owed to gdb
+};
+
+static const char hex[] = "0123456789abcdef";
+
+static int fromHex(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+static char *putByte(char *p, uint8_t v) {
+  *p++ = hex[v >> 4];
+  *p++ = hex[v & 15];
+  return p;
+}
+
+static int getByte(const char *p) {
+  int hi = fromHex(p[0]), lo = fromHex(p[1]);
+  return hi < 0 || lo < 0 ? -1 : (hi << 4) | lo;
+}
+
+static void sendPacket(GdbStub *gdb, const char *body) {
+  char buf[PACKET_MAX + 4];
+  uint8_t sum = 0;
+  size_t n = 0;
+  buf[n++] = '$';
+  for (const char *p = body; *p && n < PACKET_MAX; p++) {
+    buf[n++] = *p;
+    sum += (uint8_t)*p;
+  }
+  buf[n++] = '#';
+  putByte(&buf[n], sum);
+  n += 2;
+  if (write(gdb->fd, buf, n) < 0)
+    perror("gdb");
+}
+
+static void sendStopReply(GdbStub *gdb) {
+  char reply[32];
+  const Debugger *debugger = gdb->debugger;
+  if (gdb->reason == STOP_WATCH) {
+    const char *kind = debugger->watch_write ? "" : "r";
+    if (debugger->watches[debugger->watch_addr] & DEBUG_WATCH_ACCESS)
+      kind = "a";
+    snprintf(reply, sizeof(reply), "T05%swatch:%04x;", kind,
+             debugger->watch_addr);
+  } else if (gdb->reason < 0) {
+    snprintf(reply, sizeof(reply), "T05replaylog:begin;");
+  } else {
+    snprintf(reply, sizeof(reply), "S05");
+  }
+  sendPacket(gdb, reply);
+}
+
+// af bc de hl sp pc as gdb's Z80 sees them
+static void readRegs(const CPUState *state, uint16_t *regs) {
+  regs[0] = (state->a << 8) | traceFlags(state);
+  regs[1] = (state->b << 8) | state->c;
+  regs[2] = (state->d << 8) | state->e;
+  regs[3] = (state->h << 8) | state->l;
+  regs[4] = state->sp;
+  regs[5] = state->pc;
+}
+
+static void writeReg(CPUState *state, int n, uint16_t v) {
+  switch (n) {
+  case 0:
+    state->a = v >> 8;
+    traceSetFlags(state, v);
+    break;
+  case 1:
+    state->b = v >> 8;
+    state->c = v;
+    break;
+  case 2:
+    state->d = v >> 8;
+    state->e = v;
+    break;
+  case 3:
+    state->h = v >> 8;
+    state->l = v;
+    break;
+  case 4:
+    state->sp = v;
+    break;
+  case 5:
+    state->pc = v;
+    break;
+  }
+}
+
+#define Z80_REGS 13
+
+static void handleRegs(GdbStub *gdb, const char *args, char *reply) {
+  uint16_t regs[6];
+  readRegs(gdb->state, regs);
+  char *p = reply;
+  for (int i = 0; i < Z80_REGS; i++) {
+    uint16_t v = i < 6 ? regs[i] : 0;
+    p = putByte(p, v & 0xff);
+    p = putByte(p, v >> 8);
+  }
+  *p = '\0';
+  (void)args;
+}
+
+static void handleWriteRegs(GdbStub *gdb, const char *args, char *reply) {
+  for (int i = 0; i < 6 && strlen(args) >= (size_t)(i + 1) * 4; i++) {
+    int lo = getByte(&args[i * 4]), hi = getByte(&args[i * 4 + 2]);
+    if (lo < 0 || hi < 0)
+      break;
+    writeReg(gdb->state, i, (hi << 8) | lo);
+  }
+  strcpy(reply, "OK");
+}
+
+// P n=vvvv
+static void handleWriteReg(GdbStub *gdb, const char *args, char *reply) {
+  unsigned int n;
+  const char *eq = strchr(args, '=');
+  if (sscanf(args, "%x", &n) != 1 || eq == NULL || strlen(eq + 1) < 4) {
+    strcpy(reply, "E01");
+    return;
+  }
+  int lo = getByte(eq + 1), hi = getByte(eq + 3);
+  if (n < 6 && lo >= 0 && hi >= 0)
+    writeReg(gdb->state, n, (hi << 8) | lo);
+  strcpy(reply, "OK");
+}
+
+static void handleReadReg(GdbStub *gdb, const char *args, char *reply) {
+  unsigned int n;
+  uint16_t regs[6];
+  if (sscanf(args, "%x", &n) != 1) {
+    strcpy(reply, "E01");
+    return;
+  }
+  readRegs(gdb->state, regs);
+  uint16_t v = n < 6 ? regs[n] : 0;
+  *putByte(putByte(reply, v & 0xff), v >> 8) = '\0';
+}
+
+// m addr,len
+static void handleReadMemory(GdbStub *gdb, const char *args, char *reply) {
+  unsigned int addr, len;
+  if (sscanf(args, "%x,%x", &addr, &len) != 2 ||
+      addr + len > MEMORY_SIZE || len * 2 >= PACKET_MAX) {
+    strcpy(reply, "E01");
+    return;
+  }
+  char *p = reply;
+  for (unsigned int i = 0; i < len; i++) {
+    p = putByte(p, gdb->state->memory[addr + i]);
+  }
+  *p = '\0';
+}
+
+// M addr,len:bytes
+static void handleWriteMemory(GdbStub *gdb, const char *args, char *reply) {
+  unsigned int addr, len;
+  const char *data = strchr(args, ':');
+  if (sscanf(args, "%x,%x", &addr, &len) != 2 || data == NULL ||
+      addr + len > MEMORY_SIZE || strlen(data + 1) < len * 2) {
+    strcpy(reply, "E01");
+    return;
+  }
+  for (unsigned int i = 0; i < len; i++) {
+    int v = getByte(data + 1 + i * 2);
+    // the ROM is mapped read-only
+    if (v < 0 || (gdb->state->page_flags[(addr + i) >> 8] & PAGE_ROM)) {
+      strcpy(reply, "E01");
+      return;
+    }
+    gdb->state->memory[addr + i] = v;
+    gdb->state->dirty[(addr + i) >> 8] = 1;
+  }
+  strcpy(reply, "OK");
+}
+
+// Z type,addr,kind and z type,addr,kind
+static void handleBreak(GdbStub *gdb, const char *args, int on, char *reply) {
+  unsigned int type, addr, len;
+  if (sscanf(args, "%u,%x,%x", &type, &addr, &len) != 3 || addr > 0xffff) {
+    strcpy(reply, "E01");
+    return;
+  }
+  static const uint8_t watch_bits[] = {
+      [2] = PAGE_WATCH_WRITE,
+      [3] = PAGE_WATCH_READ,
+      [4] = PAGE_WATCH_READ | PAGE_WATCH_WRITE | DEBUG_WATCH_ACCESS,
+  };
+  if (type <= 1) {
+    // software and hardware breakpoints are the same thing here
+    debugSetBreak(gdb->debugger, addr, on);
+  } else if (type <= 4) {
+    debugSetWatch(gdb->debugger, gdb->state, addr, len ? len : 1,
+                  watch_bits[type], on);
+  } else {
+    reply[0] = '\0';
+    return;
+  }
+  strcpy(reply, "OK");
+}
+
+// Registers or memory changed under a recorded history
+static void edited(GdbStub *gdb) {
+  if (gdb->debugger->timeline != NULL)
+    timelineTruncate(gdb->debugger->timeline, gdb->state);
+}
+
+// bs and bc, done right here while the run loop stays parked
+static void reverse(GdbStub *gdb, int step) {
+  Timeline *timeline = gdb->debugger->timeline;
+  if (timeline == NULL) {
+    sendPacket(gdb, "E01");
+    return;
+  }
+  if (step)
+    gdb->reason = timelineReverseStep(timeline, gdb->state) ? STOP_STEP : -1;
+  else
+    gdb->reason =
+        timelineReverseContinue(timeline, gdb->state, gdb->debugger);
+  sendStopReply(gdb);
+}
+
+static void resume(GdbStub *gdb, int how) {
+  gdb->resume = how;
+  gdb->awaiting_stop = how != RESUME_QUIT;
+  pthread_cond_signal(&gdb->cond);
+}
+
+// Runs with the lock held and the run loop parked
+static void handlePacket(GdbStub *gdb, const char *packet) {
+  char reply[PACKET_MAX];
+  reply[0] = '\0';
+  const char *args = packet + 1;
+
+  switch (packet[0]) {
+  case '?':
+    sendStopReply(gdb);
+    return;
+  case 'g':
+    handleRegs(gdb, args, reply);
+    break;
+  case 'G':
+    handleWriteRegs(gdb, args, reply);
+    edited(gdb);
+    break;
+  case 'p':
+    handleReadReg(gdb, args, reply);
+    break;
+  case 'P':
+    handleWriteReg(gdb, args, reply);
+    edited(gdb);
+    break;
+  case 'm':
+    handleReadMemory(gdb, args, reply);
+    break;
+  case 'M':
+    handleWriteMemory(gdb, args, reply);
+    edited(gdb);
+    break;
+  case 'Z':
+    handleBreak(gdb, args, 1, reply);
+    break;
+  case 'z':
+    handleBreak(gdb, args, 0, reply);
+    break;
+  case 'H':
+    strcpy(reply, "OK");
+    break;
+  case 'c':
+    resume(gdb, RESUME_CONTINUE);
+    return;
+  case 's':
+    resume(gdb, RESUME_STEP);
+    return;
+  case 'k':
+    resume(gdb, RESUME_QUIT);
+    return;
+  case 'b':
+    if (args[0] == 's' || args[0] == 'c') {
+      reverse(gdb, args[0] == 's');
+      return;
+    }
+    break;
+  case 'D':
+    sendPacket(gdb, "OK");
+    resume(gdb, RESUME_CONTINUE);
+    gdb->awaiting_stop = 0;
+    return;
+  case 'q':
+    if (strncmp(args, "Supported", 9) == 0)
+      snprintf(reply, sizeof(reply),
+               "PacketSize=%x;ReverseStep+;ReverseContinue+", PACKET_MAX);
+    else if (strcmp(args, "Attached") == 0)
+      strcpy(reply, "1");
+    break;
+  }
+  sendPacket(gdb, reply);
+}
+
+// Splits the bytes read into acks, ^C and $packet#xx
+static void handleInput(GdbStub *gdb, char *buf, size_t *len) {
+  size_t i = 0;
+  while (i < *len) {
+    if (buf[i] == 0x03) {
+      pthread_mutex_lock(&gdb->lock);
+      if (!gdb->stopped) {
+        atomic_store(&gdb->interrupt, 1);
+        gdb->awaiting_stop = 1;
+      }
+      pthread_mutex_unlock(&gdb->lock);
+      i++;
+      continue;
+    }
+    if (buf[i] != '$') {
+      i++; // acks and noise
+      continue;
+    }
+    char *end = memchr(&buf[i], '#', *len - i);
+    if (end == NULL || end + 2 >= buf + *len)
+      break; // incomplete, wait for more
+
+    *end = '\0';
+    uint8_t sum = 0;
+    for (char *p = &buf[i + 1]; p < end; p++) {
+      sum += (uint8_t)*p;
+    }
+    if (getByte(end + 1) != sum) {
+      if (write(gdb->fd, "-", 1) < 0)
+        perror("gdb");
+    } else {
+      if (write(gdb->fd, "+", 1) < 0)
+        perror("gdb");
+      pthread_mutex_lock(&gdb->lock);
+      // all-stop: only ^C means anything while the emulator runs
+      if (gdb->stopped && gdb->resume == RESUME_NONE)
+        handlePacket(gdb, &buf[i + 1]);
+      pthread_mutex_unlock(&gdb->lock);
+    }
+    i = end + 3 - buf;
+  }
+  memmove(buf, buf + i, *len - i);
+  *len -= i;
+}
+
+static void serve(GdbStub *gdb) {
+  char buf[PACKET_MAX * 2 + 8];
+  size_t len = 0;
+  struct pollfd fds[2] = {{gdb->fd, POLLIN, 0}, {gdb->event_fd, POLLIN, 0}};
+
+  while (!atomic_load(&gdb->closing)) {
+    if (poll(fds, 2, 100) < 0 && errno != EINTR)
+      break;
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t n;
+      if (read(gdb->event_fd, &n, sizeof(n)) < 0)
+        perror("gdb");
+      pthread_mutex_lock(&gdb->lock);
+      if (gdb->awaiting_stop && gdb->stopped) {
+        gdb->awaiting_stop = 0;
+        sendStopReply(gdb);
+      }
+      pthread_mutex_unlock(&gdb->lock);
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t n = read(gdb->fd, buf + len, sizeof(buf) - len);
+      if (n <= 0)
+        break;
+      len += n;
+      handleInput(gdb, buf, &len);
+      if (len == sizeof(buf))
+        len = 0; // garbage, drop it
+    }
+  }
+}
+
+static void *stubThread(void *arg) {
+  GdbStub *gdb = arg;
+  while (!atomic_load(&gdb->closing)) {
+    struct pollfd pfd = {gdb->listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+    int fd = accept(gdb->listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+
+    pthread_mutex_lock(&gdb->lock);
+    gdb->fd = fd;
+    pthread_mutex_unlock(&gdb->lock);
+    serve(gdb);
+
+    // gdb went away: let the program run on
+    pthread_mutex_lock(&gdb->lock);
+    if (gdb->stopped && gdb->resume == RESUME_NONE)
+      resume(gdb, RESUME_CONTINUE);
+    gdb->awaiting_stop = 0;
+    gdb->fd = -1;
+    pthread_mutex_unlock(&gdb->lock);
+    close(fd);
+  }
+  return NULL;
+}
+
+static int listenOn(const char *address, char *path) {
+  int fd;
+  if (strchr(address, '/') != NULL) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(address) >= sizeof(addr.sun_path))
+      return -1;
+    strcpy(addr.sun_path, address);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(address);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      goto fail;
+    strcpy(path, address);
+  } else {
+    struct sockaddr_in addr = {.sin_family = AF_INET};
+    addr.sin_port = htons(atoi(address));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    if (fd < 0)
+      return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+      goto fail;
+  }
+  if (listen(fd, 1) < 0)
+    goto fail;
+  return fd;
+
+fail:
+  if (fd >= 0)
+    close(fd);
+  return -1;
+}
+
+GdbStub *gdbOpen(const char *address, CPUState *state, Debugger *debugger) {
+  GdbStub *gdb = calloc(1, sizeof(GdbStub));
+  gdb->listen_fd = listenOn(address, gdb->path);
+  if (gdb->listen_fd < 0) {
+    free(gdb);
+    return NULL;
+  }
+  gdb->state = state;
+  gdb->debugger = debugger;
+  gdb->fd = -1;
+  gdb->event_fd = eventfd(0, 0);
+  pthread_mutex_init(&gdb->lock, NULL);
+  pthread_cond_init(&gdb->cond, NULL);
+  pthread_create(&gdb->thread, NULL, stubThread, gdb);
+  return gdb;
+}
+
+void gdbClose(GdbStub *gdb) {
+  // the program ended: tell an attached gdb, whatever it's waiting for
+  pthread_mutex_lock(&gdb->lock);
+  if (gdb->fd >= 0)
+    sendPacket(gdb, "W00");
+  pthread_mutex_unlock(&gdb->lock);
+  atomic_store(&gdb->closing, 1);
+  pthread_join(gdb->thread, NULL);
+  close(gdb->listen_fd);
+  close(gdb->event_fd);
+  if (gdb->path[0])
+    unlink(gdb->path);
+  pthread_mutex_destroy(&gdb->lock);
+  pthread_cond_destroy(&gdb->cond);
+  free(gdb);
+}
+
+int gdbInterrupted(GdbStub *gdb) {
+  return atomic_load_explicit(&gdb->interrupt, memory_order_relaxed) &&
+         atomic_exchange(&gdb->interrupt, 0);
+}
+
+int gdbStopped(GdbStub *gdb, int reason) {
+  pthread_mutex_lock(&gdb->lock);
+  gdb->stopped = 1;
+  gdb->reason = reason;
+  gdb->resume = RESUME_NONE;
+  uint64_t one = 1;
+  if (write(gdb->event_fd, &one, sizeof(one)) < 0)
+    perror("gdb");
+  while (gdb->resume == RESUME_NONE) {
+    pthread_cond_wait(&gdb->cond, &gdb->lock);
+  }
+  int how = gdb->resume;
+  gdb->stopped = 0;
+  gdb->resume = RESUME_NONE;
+  pthread_mutex_unlock(&gdb->lock);
+
+  if (how == RESUME_STEP)
+    debugStep(gdb->debugger);
+  return how == RESUME_QUIT ? DEBUG_QUIT : DEBUG_CONTINUE;
+}
@@ -0,0 +1,36 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+// GDB remote serial protocol server. It runs on its own thread and only
+// touches the CPU while the run loop is parked in gdbStopped; while the
+// emulator runs, the one thing it does is flag a ^C, which the run loop
+// picks up at its next slice boundary.
+//
+// There is no 8080 target in gdb, but the 8080 is a subset of the Z80 and
+// the register packets use gdb's Z80 layout: af bc de hl sp pc, then ix iy
+// af' bc' de' hl' ir, which read as zero. Connect with
+//   (gdb) set architecture z80
+//   (gdb) target remote <port or socket path>
+// Z0/Z1 breakpoints and Z2/Z3/Z4 watchpoints map onto debug.h; bs and bc
+// (reverse-stepi, reverse-continue) onto the debugger's timeline.
+
+#include <stdint.h>
+
+#include "debug.h"
+#include "emu.h"
+
+typedef struct GdbStub GdbStub;
+
+// address is a TCP port on 127.0.0.1, or a Unix socket path if it contains
+// a '/'. Returns NULL if it can't listen there.
+GdbStub *gdbOpen(const char *address, CPUState *state, Debugger *debugger);
+void gdbClose(GdbStub *gdb);
+
+// Slice boundary check: whether gdb asked the emulator to stop
+int gdbInterrupted(GdbStub *gdb);
+
+// Called by the run loop on a debugger stop instead of debugMonitor. Hands
+// the CPU to gdb until it continues, steps or kills.
+int gdbStopped(GdbStub *gdb, int reason);
+
+#endif
@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "invaders.h"
+#include "ops.h"
+
+static uint8_t invadersIn(void *ctx, uint8_t port) {
+  InvadersBoard *board = ctx;
+  switch (port) {
+  case 1:
+    return board->port1 | 0x08;
+  case 2:
+    return board->port2;
+  case 3:
+    return board->shift >> (8 - board->shift_offset);
+  default:
+    return 0;
+  }
+}
+
+static void invadersOut(void *ctx, uint8_t port, uint8_t value) {
+  InvadersBoard *board = ctx;
+  switch (port) {
+  case 2:
+    board->shift_offset = value & 7;
+    break;
+  case 3:
+    board->sound[0] = value;
+    break;
+  case 4:
+    board->shift = (value << 8) | (board->shift >> 8);
+    break;
+  case 5:
+    board->sound[1] = value;
+    break;
+  case 6:
+    board->watchdog = value;
+    break;
+  }
+}
+
+void invadersInit(InvadersBoard *board, CPUState *state) {
+  memset(board, 0, sizeof(InvadersBoard));
+  board->vector = 1;
+  board->next_interrupt =
+      (state->cycles / CYCLES_PER_HALF_FRAME + 1) * CYCLES_PER_HALF_FRAME;
+  state->next_event = board->next_interrupt;
+  // stores to the ROM, through any mirror, go nowhere
+  for (int page = 0; page < ROM_SIZE >> 8; page++) {
+    state->page_flags[page] |= PAGE_ROM;
+  }
+  state->port_in = invadersIn;
+  state->port_out = invadersOut;
+  state->port_ctx = board;
+}
+
+int invadersRunFrame(InvadersBoard *board, CPUState *state,
+                     uint8_t *registers[], const uint8_t *kinds,
+                     FusionStats *stats) {
+  uint64_t end = (state->cycles / CYCLES_PER_FRAME + 1) * CYCLES_PER_FRAME;
+  while (state->cycles < end) {
+    if (!instructionFits(state->memory, MEMORY_SIZE, state->pc))
+      return 0;
+    uint8_t kind = kinds != NULL ? kinds[state->pc] : FUSE_NONE;
+    if (stats != NULL) {
+      stats->dispatches++;
+      stats->hits[kind]++;
+    }
+    if (kind == FUSE_NONE)
+      handleOpcode(state, registers);
+    else
+      handleFusedOpcode(state, kind, registers);
+    invadersTick(board, state);
+  }
+  return 1;
+}
+
+// The board doesn't hold the request: one raised while interrupts are
+// disabled is lost
+void invadersInterrupt(InvadersBoard *board, CPUState *state) {
+  i8080_interrupt(state, board->vector);
+  board->vector ^= 3;
+  board->next_interrupt += CYCLES_PER_HALF_FRAME;
+  state->next_event = board->next_interrupt;
+}
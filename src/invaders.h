@@ -0,0 +1,76 @@
+#ifndef INVADERS_H
+#define INVADERS_H
+
+// The Space Invaders board around the CPU: the input ports, the external
+// shift register the game draws sprites with, and the two video interrupts
+// (RST 1 when the beam reaches mid-screen, RST 2 at vblank).
+//
+// Interrupts fall on absolute cycle counts, every half frame since reset,
+// so a run is a pure function of the ROM and the values read from the
+// input ports. The board holds no pointers and can be saved and restored
+// with memcpy (the timeline keeps it with its keyframes).
+
+#include <stdint.h>
+
+#include "emu.h"
+#include "fusion.h"
+
+// 2 MHz at 60 Hz, rounded so a frame is two whole half frames: frame ends,
+// where callers change the inputs, then fall on the vblank interrupt, which
+// superinstructions stop at (emu.h), so fused and unfused runs see new
+// inputs at the same instruction
+#define CYCLES_PER_HALF_FRAME 16667
+#define CYCLES_PER_FRAME (2 * CYCLES_PER_HALF_FRAME)
+
+// Enough for the ROM to get through its RAM tests into attract mode
+#define INVADERS_BOOT_FRAMES 120
+
+// 1 while a game is in progress, 0 in attract mode
+#define INVADERS_GAME_MODE 0x20ef
+
+// Port 1
+#define INVADERS_COIN 0x01
+#define INVADERS_P2_START 0x02
+#define INVADERS_P1_START 0x04
+#define INVADERS_P1_SHOT 0x10
+#define INVADERS_P1_LEFT 0x20
+#define INVADERS_P1_RIGHT 0x40
+// Port 2, the rest are DIP switches
+#define INVADERS_TILT 0x04
+#define INVADERS_P2_SHOT 0x10
+#define INVADERS_P2_LEFT 0x20
+#define INVADERS_P2_RIGHT 0x40
+
+typedef struct {
+  uint8_t port1;  // coin, start buttons, player 1; bit 3 always reads 1
+  uint8_t port2;  // DIP switches, tilt, player 2
+  uint16_t shift; // last two bytes written to port 4, newest on top
+  uint8_t shift_offset;
+  uint8_t sound[2];  // last writes to ports 3 and 5
+  uint8_t watchdog;  // writes to port 6, not acted on
+  uint8_t vector;    // RST of the next interrupt: 1 mid-screen, 2 vblank
+  uint64_t next_interrupt; // cycle it falls on
+} InvadersBoard;
+
+// Resets the board with no buttons pressed, wires it into state's port
+// hooks and makes the ROM pages read-only
+void invadersInit(InvadersBoard *board, CPUState *state);
+
+void invadersInterrupt(InvadersBoard *board, CPUState *state);
+
+// Runs state on the board to the end of the frame its clock is in,
+// dispatching through kinds (fusionPredecode's table, NULL to run every
+// instruction on its own) and counting dispatches in stats if it isn't
+// NULL. Returns 0, stopped there, when the instruction at pc runs past
+// MEMORY_SIZE.
+int invadersRunFrame(InvadersBoard *board, CPUState *state,
+                     uint8_t *registers[], const uint8_t *kinds,
+                     FusionStats *stats);
+
+// Called between instructions: raises the video interrupt that is due
+static inline void invadersTick(InvadersBoard *board, CPUState *state) {
+  if (state->cycles >= board->next_interrupt)
+    invadersInterrupt(board, state);
+}
+
+#endif
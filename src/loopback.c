@@ -0,0 +1,54 @@
+#include <string.h>
+
+#include "loopback.h"
+
+static uint64_t next(Loopback *link) {
+  link->rng ^= link->rng >> 12;
+  link->rng ^= link->rng << 25;
+  link->rng ^= link->rng >> 27;
+  return link->rng * 0x2545f4914f6cdd1dull;
+}
+
+void loopbackInit(Loopback *link, uint32_t latency_us, uint32_t jitter_us,
+                  double loss, uint64_t seed) {
+  memset(link, 0, sizeof(Loopback));
+  link->latency_us = latency_us;
+  link->jitter_us = jitter_us;
+  link->loss = loss;
+  link->rng = seed | 1;
+}
+
+void loopbackSend(Loopback *link, int from, const uint8_t *data, int size,
+                  uint64_t now_us) {
+  int to = !from;
+  link->sent++;
+  if ((next(link) >> 11) * 0x1.0p-53 < link->loss || size > LOOPBACK_MTU ||
+      link->n_queued[to] == LOOPBACK_QUEUE) {
+    link->lost++;
+    return;
+  }
+  LoopbackPacket *packet = &link->queue[to][link->n_queued[to]++];
+  uint64_t jitter =
+      link->jitter_us ? next(link) % ((uint64_t)link->jitter_us + 1) : 0;
+  packet->deliver_us = now_us + link->latency_us + jitter;
+  packet->size = size;
+  memcpy(packet->data, data, size);
+}
+
+int loopbackReceive(Loopback *link, int to, uint8_t *data, uint64_t now_us) {
+  // jitter reorders packets: take the earliest one due
+  LoopbackPacket *queue = link->queue[to];
+  int best = -1;
+  for (int i = 0; i < link->n_queued[to]; i++) {
+    if (queue[i].deliver_us <= now_us &&
+        (best < 0 || queue[i].deliver_us < queue[best].deliver_us))
+      best = i;
+  }
+  if (best < 0)
+    return 0;
+  int size = queue[best].size;
+  memcpy(data, queue[best].data, size);
+  queue[best] = queue[--link->n_queued[to]];
+  link->delivered++;
+  return size;
+}
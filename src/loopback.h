@@ -0,0 +1,44 @@
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+// In-process datagram link between two endpoints (0 and 1) for testing
+// netcode: each packet is delivered after a latency with random jitter, or
+// lost. Time is whatever clock the caller passes in, in microseconds, so a
+// test can run in simulated time, as fast as the machines go.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOOPBACK_MTU 64
+#define LOOPBACK_QUEUE 256 // packets in flight per direction
+
+typedef struct {
+  uint64_t deliver_us;
+  uint8_t size;
+  uint8_t data[LOOPBACK_MTU];
+} LoopbackPacket;
+
+typedef struct {
+  uint32_t latency_us; // one way
+  uint32_t jitter_us;  // added latency, uniform in [0, jitter_us]
+  double loss;         // probability a packet is dropped
+  uint64_t rng;
+
+  LoopbackPacket queue[2][LOOPBACK_QUEUE]; // by receiving endpoint
+  int n_queued[2];
+
+  uint64_t sent;
+  uint64_t lost; // dropped on purpose or because the queue was full
+  uint64_t delivered;
+} Loopback;
+
+void loopbackInit(Loopback *link, uint32_t latency_us, uint32_t jitter_us,
+                  double loss, uint64_t seed);
+// From endpoint from to the other one. Packets over LOOPBACK_MTU are lost.
+void loopbackSend(Loopback *link, int from, const uint8_t *data, int size,
+                  uint64_t now_us);
+// A packet for endpoint to that is due by now, in the order they fall
+// due; returns its size, 0 if there's none
+int loopbackReceive(Loopback *link, int to, uint8_t *data, uint64_t now_us);
+
+#endif
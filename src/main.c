@@ -0,0 +1,460 @@
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "callstack.h"
+#include "coverage.h"
+#include "debug.h"
+#include "emu.h"
+#ifdef EMBEDDED_ROM
+#include "embedded.h"
+#endif
+#include "fusion.h"
+#include "gdbstub.h"
+#include "invaders.h"
+#include "memstats.h"
+#include "ops.h"
+#include "perf.h"
+#include "profiler.h"
+#include "romset.h"
+#include "runahead.h"
+#include "throttle.h"
+#include "timeline.h"
+#include "trace.h"
+#include "tracedelta.h"
+#include "video.h"
+
+// 1 ms of 8080 time. Other threads (the gdb stub) only get at the CPU
+// between slices.
+#define SLICE_CYCLES 2000
+
+// Records buffered between the emulator and the trace writer
+#define TRACE_CAPACITY (1 << 20)
+
+#ifdef EMBEDDED_ROM
+#define ROM_ARGUMENT "[rom|romdir]"
+#else
+#define ROM_ARGUMENT "rom|romdir"
+#endif
+
+// Ctrl-C ends the run at the next slice, so the reports (the coverage map,
+// the throttle's jitter, --perf, the profiles) still get written and the
+// traces get their tails and indexes
+static volatile sig_atomic_t interrupted;
+
+static void onInterrupt(int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+typedef struct {
+  uint8_t **registers;
+  InvadersBoard *board;
+} Machine;
+
+// The run loop minus fusion, for the timeline to re-execute history with
+static void stepMachine(void *ctx, CPUState *state) {
+  Machine *machine = ctx;
+  handleOpcode(state, machine->registers);
+  invadersTick(machine->board, state);
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [--trace file] [--trace-delta file] [--perf] "
+          "[--no-fusion] [--debug] [--gdb port|socket] [--coverage file] "
+          "[--realtime] [--scanline] [--turbo speed|max] [--video file] "
+          "[--video-fps fps] [--input file] [--run-ahead frames] %s\n",
+          prog, ROM_ARGUMENT);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+      {"trace", required_argument, NULL, 't'},
+      {"trace-delta", required_argument, NULL, 'd'},
+      {"perf", no_argument, NULL, 'p'},
+      {"no-fusion", no_argument, NULL, 'f'},
+      {"debug", no_argument, NULL, 'g'},
+      {"gdb", required_argument, NULL, 'G'},
+      {"coverage", required_argument, NULL, 'c'},
+      {"realtime", no_argument, NULL, 'r'},
+      {"scanline", no_argument, NULL, 's'},
+      {"turbo", required_argument, NULL, 'T'},
+      {"video", required_argument, NULL, 'v'},
+      {"video-fps", required_argument, NULL, 'F'},
+      {"input", required_argument, NULL, 'i'},
+      {"run-ahead", required_argument, NULL, 'a'},
+      {NULL, 0, NULL, 0},
+  };
+  const char *trace_path = NULL;
+  const char *delta_path = NULL;
+  int perf_mode = 0;
+  int fusion = 1;
+  int debug = 0;
+  const char *gdb_address = NULL;
+  const char *coverage_path = NULL;
+  // real time: wait for the wall clock every pace_cycles, speed times 2 MHz
+  uint64_t pace_cycles = 0;
+  double speed = 1;
+  const char *video_path = NULL;
+  const char *input_path = NULL;
+  double video_fps = 60;
+  int run_ahead = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "t:d:", options, NULL)) != -1) {
+    switch (opt) {
+    case 't':
+      trace_path = optarg;
+      break;
+    case 'd':
+      delta_path = optarg;
+      break;
+    case 'p':
+      perf_mode = 1;
+      break;
+    case 'f':
+      fusion = 0;
+      break;
+    case 'g':
+      debug = 1;
+      break;
+    case 'G':
+      gdb_address = optarg;
+      break;
+    case 'c':
+      coverage_path = optarg;
+      break;
+    case 'r':
+      if (pace_cycles == 0)
+        pace_cycles = CYCLES_PER_FRAME;
+      break;
+    case 's':
+      pace_cycles = CYCLES_PER_SCANLINE;
+      break;
+    case 'T':
+      // 2, 10, ... times real time, or as fast as it goes
+      speed = strcmp(optarg, "max") == 0 ? 0 : atof(optarg);
+      if (speed <= 0 && strcmp(optarg, "max") != 0)
+        usage(argv[0]);
+      if (pace_cycles == 0)
+        pace_cycles = CYCLES_PER_FRAME;
+      break;
+    case 'v':
+      video_path = optarg;
+      break;
+    case 'F':
+      video_fps = atof(optarg);
+      if (video_fps <= 0)
+        usage(argv[0]);
+      break;
+    case 'i':
+      input_path = optarg;
+      break;
+    case 'a':
+      run_ahead = atoi(optarg);
+      if (run_ahead < 1)
+        usage(argv[0]);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind < argc - 1)
+    usage(argv[0]);
+  // only frames that get presented are run ahead for, and a debugger
+  // would see the machine go back in time
+  if (run_ahead && (video_path == NULL || debug || gdb_address != NULL))
+    usage(argv[0]);
+  // without one, an EMBED_ROM build starts from its built-in ROM
+  const char *rom_path = optind < argc ? argv[optind] : NULL;
+#ifndef EMBEDDED_ROM
+  if (rom_path == NULL)
+    usage(argv[0]);
+#endif
+
+  CPUState cpu_state = {0};
+  cpu_state.memory = (uint8_t *)calloc(MEMORY_SIZE, 1);
+  cpu_state.pc = PROGRAM_START;
+
+  uint8_t *registers[8];
+  registers[0] = &cpu_state.b;
+  registers[1] = &cpu_state.c;
+  registers[2] = &cpu_state.d;
+  registers[3] = &cpu_state.e;
+  registers[4] = &cpu_state.h;
+  registers[5] = &cpu_state.l;
+  registers[6] = NULL; // mem reg
+  registers[7] = &cpu_state.a;
+
+  static InvadersBoard board;
+  invadersInit(&board, &cpu_state);
+
+  long fsize;
+#ifdef EMBEDDED_ROM
+  if (rom_path == NULL) {
+    // already in attract mode
+    embeddedStart(&cpu_state, &board);
+    fsize = embeddedRomSize;
+  } else
+#endif
+  {
+    // a ROM set directory or a single image
+    fsize = romLoad(rom_path, cpu_state.memory, MEMORY_SIZE);
+    if (fsize < 0)
+      exit(1);
+    romCheck(rom_path, cpu_state.memory, fsize);
+  }
+
+  Tracer *tracer = NULL;
+  if (trace_path != NULL) {
+    tracer = tracerOpen(trace_path, TRACE_CAPACITY);
+    if (tracer == NULL) {
+      printf("error: Couldn't open trace file %s\n", trace_path);
+      exit(1);
+    }
+  }
+
+  DeltaWriter *delta = NULL;
+  if (delta_path != NULL) {
+    delta = deltaWriterOpen(delta_path, &cpu_state, DELTA_INTERVAL);
+    if (delta == NULL) {
+      printf("error: Couldn't open trace file %s\n", delta_path);
+      exit(1);
+    }
+  }
+
+  static Coverage coverage;
+  Coverage *covered = coverage_path != NULL ? &coverage : NULL;
+
+  // superinstructions are only predecoded for ROM, which is never written.
+  // A trace, coverage map or profile wants every instruction, so nothing is
+  // fused then. The table covers all of memory so the debugger can patch
+  // breakpoints in.
+  uint8_t *fused = calloc(DEBUG_SPACE, 1);
+  int tracing = tracer != NULL || delta != NULL;
+  if (tracing || covered != NULL)
+    fusion = 0;
+#ifdef PROFILER
+  fusion = 0;
+#endif
+  if (fusion)
+    fusionPredecode(cpu_state.memory, fsize < ROM_SIZE ? fsize : ROM_SIZE,
+                    fused);
+
+  Machine machine = {registers, &board};
+
+  static Debugger debugger;
+  static Timeline timeline;
+  Timeline *history = NULL;
+  GdbStub *gdb = NULL;
+  if (debug || gdb_address != NULL) {
+    debugAttach(&debugger, &cpu_state, fused);
+    debugStep(&debugger);
+    timelineAttach(&timeline, &cpu_state, stepMachine, &machine, &board,
+                   sizeof(board));
+    debugger.timeline = history = &timeline;
+  }
+  if (gdb_address != NULL) {
+    gdb = gdbOpen(gdb_address, &cpu_state, &debugger);
+    if (gdb == NULL) {
+      printf("error: Couldn't listen for gdb on %s\n", gdb_address);
+      exit(1);
+    }
+  }
+
+  // frames out and buttons in on the presentation thread, handed over
+  // once per emulated frame
+  Video *video = NULL;
+  uint64_t frame_end = UINT64_MAX;
+  if (video_path != NULL || input_path != NULL) {
+    video = videoOpen(video_path, input_path, video_fps);
+    if (video == NULL)
+      exit(1);
+    frame_end = (cpu_state.cycles / CYCLES_PER_FRAME + 1) * CYCLES_PER_FRAME;
+  }
+  RunAhead ahead;
+  if (run_ahead)
+    runAheadInit(&ahead, run_ahead);
+
+#ifdef FUSION_STATS
+  FusionStats fusion_stats = {0};
+#endif
+  signal(SIGINT, onInterrupt);
+#ifdef MEMSTATS
+  uint64_t next_frame = CYCLES_PER_FRAME;
+#endif
+#ifdef CALLSTACK
+  callstackInit(cpu_state.pc, cpu_state.cycles);
+#endif
+
+  PerfCounters perf;
+  if (perf_mode) {
+    if (perfOpen(&perf) == 0)
+      fprintf(stderr, "perf: no hardware counters, timing only\n");
+    perfStart(&perf);
+  }
+
+  Throttle throttle;
+  uint64_t pace_end = UINT64_MAX;
+  if (pace_cycles) {
+    throttleInit(&throttle, speed, cpu_state.cycles, pace_cycles);
+    pace_end = (cpu_state.cycles / pace_cycles + 1) * pace_cycles;
+  }
+
+  uint64_t dispatches = 0;
+  uint64_t slice_end = cpu_state.cycles;
+  while (cpu_state.pc < fsize) {
+    if (cpu_state.cycles >= slice_end) {
+      slice_end = cpu_state.cycles + SLICE_CYCLES;
+      if (interrupted)
+        break;
+      if (history != NULL)
+        timelineTick(history, &cpu_state);
+      if (gdb != NULL && gdbInterrupted(gdb))
+        debugTrapAll(&debugger);
+    }
+    if (cpu_state.cycles >= frame_end) {
+      frame_end += CYCLES_PER_FRAME;
+      if (input_path != NULL)
+        videoInput(video, &board.port1, &board.port2);
+      if (run_ahead)
+        runAheadFrame(&ahead, &cpu_state, &board, fused, registers, video);
+      else
+        videoFrame(video, cpu_state.memory);
+    }
+    if (cpu_state.cycles >= pace_end) {
+      throttleWait(&throttle, cpu_state.cycles);
+      pace_end += pace_cycles;
+    }
+    dispatches++;
+    uint8_t kind = fused[cpu_state.pc];
+#ifdef FUSION_STATS
+    fusion_stats.dispatches++;
+    fusion_stats.hits[kind]++;
+#endif
+#ifdef MEMSTATS
+    if (cpu_state.cycles >= next_frame) {
+      memstatsFrame();
+      next_frame += CYCLES_PER_FRAME;
+    }
+#endif
+#ifdef PROFILER
+    uint16_t profile_pc = cpu_state.pc;
+    uint64_t profile_cycles = cpu_state.cycles;
+#endif
+    uint16_t from = cpu_state.pc;
+    uint8_t opcode = 0;
+    uint16_t addr = 0;
+    if (covered != NULL)
+      opcode = cpu_state.memory[from];
+    if (tracing) {
+      const uint8_t *code = &cpu_state.memory[cpu_state.pc];
+      opcode = code[0];
+      addr = effectiveAddress(&cpu_state, code);
+      if (tracer != NULL)
+        tracerRecord(tracer, &cpu_state, addr, opcodeTable[opcode].mem);
+    }
+    if (kind == FUSE_NONE) {
+      handleOpcode(&cpu_state, registers);
+    } else if (kind != FUSE_BREAK) {
+      handleFusedOpcode(&cpu_state, kind, registers);
+    } else {
+      int reason = debugStop(&debugger, &cpu_state);
+      int action =
+          gdb != NULL
+              ? gdbStopped(gdb, reason)
+              : debugMonitor(&debugger, &cpu_state, reason, stdin, stdout);
+      if (action == DEBUG_QUIT)
+        break;
+      // the clock stood still while stopped
+      if (pace_cycles)
+        throttleResync(&throttle, cpu_state.cycles);
+      handleOpcode(&cpu_state, registers);
+    }
+    if (covered != NULL)
+      coverageStep(covered, from, cpu_state.pc, opcodeLength(opcode));
+#ifdef PROFILER
+    profileStep(profile_pc, cpu_state.memory[profile_pc],
+                cpu_state.cycles - profile_cycles);
+#endif
+    if (delta != NULL) {
+      deltaWriterStep(delta, &cpu_state, opcode, addr, opcodeTable[opcode].mem);
+      // only an interrupt moves the clock between instructions
+      uint64_t before = cpu_state.cycles;
+      invadersTick(&board, &cpu_state);
+      if (cpu_state.cycles != before)
+        deltaWriterInterrupt(delta, &cpu_state);
+    } else {
+      invadersTick(&board, &cpu_state);
+    }
+  }
+
+  if (pace_cycles)
+    throttleReport(stdout, &throttle);
+  if (video != NULL) {
+    videoStop(video);
+    videoReport(stdout, video);
+    videoClose(video);
+  }
+  if (run_ahead) {
+    runAheadReport(stdout, &ahead);
+    runAheadFree(&ahead);
+  }
+  if (perf_mode) {
+    perfStop(&perf);
+    perfReport(stdout, fusion ? "fused interpreter" : "interpreter", &perf,
+               cpu_state.instructions, dispatches);
+    perfClose(&perf);
+  }
+#ifdef FUSION_STATS
+  fusionPrintStats(&fusion_stats);
+#endif
+#ifdef PROFILER
+  profileReport(stdout, cpu_state.memory, 40);
+#endif
+#ifdef CALLSTACK
+  callstackReport(stdout, cpu_state.cycles);
+  FILE *folded = fopen("callstack.folded", "w");
+  if (folded != NULL) {
+    callstackWriteFolded(folded, cpu_state.cycles);
+    fclose(folded);
+  }
+#endif
+  if (covered != NULL) {
+    FILE *out = fopen(coverage_path, "w");
+    if (out != NULL) {
+      coverageWrite(out, covered);
+      fclose(out);
+    }
+  }
+  if (gdb != NULL)
+    gdbClose(gdb);
+  if (tracer != NULL)
+    tracerClose(tracer);
+  if (delta != NULL)
+    deltaWriterClose(delta);
+#ifdef MEMSTATS
+  memstatsReport(stdout);
+  FILE *csv = fopen("memheat.csv", "w");
+  if (csv != NULL) {
+    memstatsWriteCsv(csv);
+    fclose(csv);
+  }
+  FILE *pgm = fopen("memheat.pgm", "wb");
+  if (pgm != NULL) {
+    memstatsWritePgm(pgm);
+    fclose(pgm);
+  }
+  FILE *frames = fopen("workingset.csv", "w");
+  if (frames != NULL) {
+    memstatsWriteWorkingSet(frames);
+    fclose(frames);
+  }
+#endif
+  free(fused);
+  return 0;
+}
@@ -0,0 +1,138 @@
+#ifdef MEMSTATS
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memstats.h"
+
+MemStats memstats;
+
+void memstatsRomWrite(uint16_t addr, uint16_t pc) {
+  if (memstats.rom_writes < MEMSTATS_ROM_WRITES)
+    memstats.first_rom_writes[memstats.rom_writes] = (RomWrite){pc, addr};
+  memstats.rom_writes++;
+}
+
+void memstatsReadRange(uint16_t addr, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++) {
+    memstatsRead(addr + i);
+  }
+}
+
+void memstatsWriteRange(uint16_t addr, uint32_t n, uint16_t pc) {
+  for (uint32_t i = 0; i < n; i++) {
+    memstatsWrite(addr + i, pc);
+  }
+}
+
+void memstatsFrame(void) {
+  FrameSet set = {0, 0};
+  // a page is four words of the bitmap
+  for (int page = 0; page < MEMSTATS_SPACE / 256; page++) {
+    uint32_t bytes = 0;
+    for (int w = 0; w < 4; w++) {
+      bytes += __builtin_popcountll(memstats.touched[page * 4 + w]);
+    }
+    set.bytes += bytes;
+    set.pages += bytes != 0;
+  }
+  memset(memstats.touched, 0, sizeof(memstats.touched));
+
+  if (memstats.n_frames == memstats.frames_cap) {
+    memstats.frames_cap = memstats.frames_cap ? memstats.frames_cap * 2 : 1024;
+    memstats.frames =
+        realloc(memstats.frames, memstats.frames_cap * sizeof(FrameSet));
+  }
+  memstats.frames[memstats.n_frames++] = set;
+}
+
+void memstatsWriteCsv(FILE *out) {
+  fprintf(out, "address,reads,writes\n");
+  for (uint32_t addr = 0; addr < MEMSTATS_SPACE; addr++) {
+    if (memstats.reads[addr] || memstats.writes[addr])
+      fprintf(out, "0x%04x,%" PRIu32 ",%" PRIu32 "\n", addr,
+              memstats.reads[addr], memstats.writes[addr]);
+  }
+}
+
+void memstatsWritePgm(FILE *out) {
+  double max = 0;
+  for (uint32_t addr = 0; addr < MEMSTATS_SPACE; addr++) {
+    double hits = (double)memstats.reads[addr] + memstats.writes[addr];
+    if (hits > max)
+      max = hits;
+  }
+
+  static uint8_t pixels[MEMSTATS_SPACE];
+  double scale = max > 0 ? 255 / log1p(max) : 0;
+  for (uint32_t addr = 0; addr < MEMSTATS_SPACE; addr++) {
+    double hits = (double)memstats.reads[addr] + memstats.writes[addr];
+    pixels[addr] = (uint8_t)(log1p(hits) * scale + 0.5);
+  }
+  fprintf(out, "P5\n256 256\n255\n");
+  fwrite(pixels, 1, sizeof(pixels), out);
+}
+
+void memstatsWriteWorkingSet(FILE *out) {
+  fprintf(out, "frame,bytes,pages\n");
+  for (uint32_t i = 0; i < memstats.n_frames; i++) {
+    fprintf(out, "%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n", i,
+            memstats.frames[i].bytes, memstats.frames[i].pages);
+  }
+}
+
+void memstatsReport(FILE *out) {
+  uint64_t page_hits[256] = {0};
+  uint64_t reads = 0, writes = 0;
+  for (uint32_t addr = 0; addr < MEMSTATS_SPACE; addr++) {
+    reads += memstats.reads[addr];
+    writes += memstats.writes[addr];
+    page_hits[addr >> 8] += memstats.reads[addr] + memstats.writes[addr];
+  }
+  fprintf(out, "memstats: %" PRIu64 " reads, %" PRIu64 " writes\n", reads,
+          writes);
+
+  fprintf(out, "  hottest pages:");
+  for (int i = 0; i < 8; i++) {
+    int best = -1;
+    for (int page = 0; page < 256; page++) {
+      if (page_hits[page] && (best < 0 || page_hits[page] > page_hits[best]))
+        best = page;
+    }
+    if (best < 0)
+      break;
+    fprintf(out, " %02x00 (%" PRIu64 ")", best, page_hits[best]);
+    page_hits[best] = 0;
+  }
+  fprintf(out, "\n");
+
+  if (memstats.n_frames > 0) {
+    uint32_t lo = UINT32_MAX, hi = 0;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < memstats.n_frames; i++) {
+      uint32_t bytes = memstats.frames[i].bytes;
+      lo = bytes < lo ? bytes : lo;
+      hi = bytes > hi ? bytes : hi;
+      sum += bytes;
+    }
+    fprintf(out,
+            "  working set: %" PRIu32 " frames, %" PRIu32 "-%" PRIu32
+            " bytes, mean %.0f\n",
+            memstats.n_frames, lo, hi, (double)sum / memstats.n_frames);
+  }
+
+  if (memstats.rom_writes > 0) {
+    fprintf(out, "  %" PRIu64 " writes into ROM, first:\n",
+            memstats.rom_writes);
+    for (uint64_t i = 0;
+         i < memstats.rom_writes && i < MEMSTATS_ROM_WRITES; i++) {
+      fprintf(out, "    pc %04x wrote %04x\n",
+              memstats.first_rom_writes[i].pc,
+              memstats.first_rom_writes[i].addr);
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef MEMSTATS_H
+#define MEMSTATS_H
+
+// Memory access heatmap, compiled in with -DMEMSTATS (the MEMSTATS CMake
+// option). memRead and memWrite in ops.h report every data access;
+// instruction fetches aren't counted.
+
+#ifdef MEMSTATS
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emu.h"
+
+#define MEMSTATS_SPACE 0x10000
+// First stray ROM writes kept for the report
+#define MEMSTATS_ROM_WRITES 32
+
+typedef struct {
+  uint16_t pc;
+  uint16_t addr;
+} RomWrite;
+
+// Working set of one frame
+typedef struct {
+  uint32_t bytes; // distinct addresses touched
+  uint32_t pages; // distinct 256-byte pages touched
+} FrameSet;
+
+typedef struct {
+  uint32_t reads[MEMSTATS_SPACE]; // saturating
+  uint32_t writes[MEMSTATS_SPACE];
+  // addresses touched in the current frame, one bit each
+  uint64_t touched[MEMSTATS_SPACE / 64];
+  FrameSet *frames; // per finished frame
+  uint32_t n_frames;
+  uint32_t frames_cap;
+  uint64_t rom_writes;
+  RomWrite first_rom_writes[MEMSTATS_ROM_WRITES];
+} MemStats;
+
+extern MemStats memstats;
+
+void memstatsRomWrite(uint16_t addr, uint16_t pc);
+
+static inline void memstatsRead(uint16_t addr) {
+  memstats.reads[addr] += memstats.reads[addr] != UINT32_MAX;
+  memstats.touched[addr >> 6] |= 1ull << (addr & 63);
+}
+
+// pc is the instruction doing the write
+static inline void memstatsWrite(uint16_t addr, uint16_t pc) {
+  memstats.writes[addr] += memstats.writes[addr] != UINT32_MAX;
+  memstats.touched[addr >> 6] |= 1ull << (addr & 63);
+  if (addr < ROM_SIZE)
+    memstatsRomWrite(addr, pc);
+}
+
+// For block operations that bypass memRead/memWrite (the fused loops)
+void memstatsReadRange(uint16_t addr, uint32_t n);
+void memstatsWriteRange(uint16_t addr, uint32_t n, uint16_t pc);
+
+// Closes the current frame's working set and starts the next
+void memstatsFrame(void);
+
+// address,reads,writes for every address that was touched
+void memstatsWriteCsv(FILE *out);
+// 256x256 binary PGM, one pixel per address (row = high byte), brightness
+// log-scaled by reads plus writes
+void memstatsWritePgm(FILE *out);
+// frame,bytes,pages (256-byte pages with at least one access)
+void memstatsWriteWorkingSet(FILE *out);
+// Totals, hottest pages, working-set range and stray ROM writes
+void memstatsReport(FILE *out);
+
+#endif
+
+#endif
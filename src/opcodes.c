@@ -0,0 +1,271 @@
+#include "opcodes.h"
+
+#define ALL (FLAG_Z | FLAG_S | FLAG_P | FLAG_CY | FLAG_AC)
+#define ZSPA (FLAG_Z | FLAG_S | FLAG_P | FLAG_AC)
+#define CY FLAG_CY
+#define RD MEM_READ
+#define WR MEM_WRITE
+#define RW (MEM_READ | MEM_WRITE)
+#define RD16 (MEM_READ | MEM_WORD)
+#define WR16 (MEM_WRITE | MEM_WORD)
+#define RW16 (MEM_READ | MEM_WRITE | MEM_WORD)
+
+// mnemonic, length, cycles, cycles taken, flags, mode, memory, control
+const OpcodeInfo opcodeTable[256] = {
+  /* 00 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 01 */ {"LXI B", 3, 10, 10, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 02 */ {"STAX B", 1, 7, 7, 0, MODE_BC, WR, CTRL_NONE},
+  /* 03 */ {"INX B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 04 */ {"INR B", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 05 */ {"DCR B", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 06 */ {"MVI B", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 07 */ {"RLC", 1, 4, 4, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 08 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 09 */ {"DAD B", 1, 10, 10, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 0a */ {"LDAX B", 1, 7, 7, 0, MODE_BC, RD, CTRL_NONE},
+  /* 0b */ {"DCX B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 0c */ {"INR C", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 0d */ {"DCR C", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 0e */ {"MVI C", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 0f */ {"RRC", 1, 4, 4, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 10 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 11 */ {"LXI D", 3, 10, 10, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 12 */ {"STAX D", 1, 7, 7, 0, MODE_DE, WR, CTRL_NONE},
+  /* 13 */ {"INX D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 14 */ {"INR D", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 15 */ {"DCR D", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 16 */ {"MVI D", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 17 */ {"RAL", 1, 4, 4, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 18 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 19 */ {"DAD D", 1, 10, 10, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 1a */ {"LDAX D", 1, 7, 7, 0, MODE_DE, RD, CTRL_NONE},
+  /* 1b */ {"DCX D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 1c */ {"INR E", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 1d */ {"DCR E", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 1e */ {"MVI E", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 1f */ {"RAR", 1, 4, 4, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 20 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 21 */ {"LXI H", 3, 10, 10, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 22 */ {"SHLD", 3, 16, 16, 0, MODE_DIRECT, WR16, CTRL_NONE},
+  /* 23 */ {"INX H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 24 */ {"INR H", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 25 */ {"DCR H", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 26 */ {"MVI H", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 27 */ {"DAA", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 28 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 29 */ {"DAD H", 1, 10, 10, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 2a */ {"LHLD", 3, 16, 16, 0, MODE_DIRECT, RD16, CTRL_NONE},
+  /* 2b */ {"DCX H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 2c */ {"INR L", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 2d */ {"DCR L", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 2e */ {"MVI L", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 2f */ {"CMA", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 30 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 31 */ {"LXI SP", 3, 10, 10, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 32 */ {"STA", 3, 13, 13, 0, MODE_DIRECT, WR, CTRL_NONE},
+  /* 33 */ {"INX SP", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 34 */ {"INR M", 1, 10, 10, ZSPA, MODE_M, RW, CTRL_NONE},
+  /* 35 */ {"DCR M", 1, 10, 10, ZSPA, MODE_M, RW, CTRL_NONE},
+  /* 36 */ {"MVI M", 2, 10, 10, 0, MODE_M, WR, CTRL_NONE},
+  /* 37 */ {"STC", 1, 4, 4, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 38 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 39 */ {"DAD SP", 1, 10, 10, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 3a */ {"LDA", 3, 13, 13, 0, MODE_DIRECT, RD, CTRL_NONE},
+  /* 3b */ {"DCX SP", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 3c */ {"INR A", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 3d */ {"DCR A", 1, 5, 5, ZSPA, MODE_NONE, 0, CTRL_NONE},
+  /* 3e */ {"MVI A", 2, 7, 7, 0, MODE_IMM, 0, CTRL_NONE},
+  /* 3f */ {"CMC", 1, 4, 4, CY, MODE_NONE, 0, CTRL_NONE},
+  /* 40 */ {"MOV B,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 41 */ {"MOV B,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 42 */ {"MOV B,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 43 */ {"MOV B,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 44 */ {"MOV B,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 45 */ {"MOV B,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 46 */ {"MOV B,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 47 */ {"MOV B,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 48 */ {"MOV C,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 49 */ {"MOV C,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 4a */ {"MOV C,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 4b */ {"MOV C,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 4c */ {"MOV C,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 4d */ {"MOV C,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 4e */ {"MOV C,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 4f */ {"MOV C,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 50 */ {"MOV D,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 51 */ {"MOV D,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 52 */ {"MOV D,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 53 */ {"MOV D,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 54 */ {"MOV D,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 55 */ {"MOV D,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 56 */ {"MOV D,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 57 */ {"MOV D,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 58 */ {"MOV E,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 59 */ {"MOV E,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 5a */ {"MOV E,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 5b */ {"MOV E,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 5c */ {"MOV E,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 5d */ {"MOV E,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 5e */ {"MOV E,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 5f */ {"MOV E,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 60 */ {"MOV H,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 61 */ {"MOV H,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 62 */ {"MOV H,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 63 */ {"MOV H,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 64 */ {"MOV H,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 65 */ {"MOV H,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 66 */ {"MOV H,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 67 */ {"MOV H,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 68 */ {"MOV L,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 69 */ {"MOV L,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 6a */ {"MOV L,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 6b */ {"MOV L,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 6c */ {"MOV L,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 6d */ {"MOV L,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 6e */ {"MOV L,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 6f */ {"MOV L,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 70 */ {"MOV M,B", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 71 */ {"MOV M,C", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 72 */ {"MOV M,D", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 73 */ {"MOV M,E", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 74 */ {"MOV M,H", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 75 */ {"MOV M,L", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 76 */ {"HLT", 1, 7, 7, 0, MODE_NONE, 0, CTRL_HALT},
+  /* 77 */ {"MOV M,A", 1, 7, 7, 0, MODE_M, WR, CTRL_NONE},
+  /* 78 */ {"MOV A,B", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 79 */ {"MOV A,C", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 7a */ {"MOV A,D", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 7b */ {"MOV A,E", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 7c */ {"MOV A,H", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 7d */ {"MOV A,L", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 7e */ {"MOV A,M", 1, 7, 7, 0, MODE_M, RD, CTRL_NONE},
+  /* 7f */ {"MOV A,A", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* 80 */ {"ADD B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 81 */ {"ADD C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 82 */ {"ADD D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 83 */ {"ADD E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 84 */ {"ADD H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 85 */ {"ADD L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 86 */ {"ADD M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* 87 */ {"ADD A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 88 */ {"ADC B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 89 */ {"ADC C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 8a */ {"ADC D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 8b */ {"ADC E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 8c */ {"ADC H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 8d */ {"ADC L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 8e */ {"ADC M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* 8f */ {"ADC A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 90 */ {"SUB B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 91 */ {"SUB C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 92 */ {"SUB D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 93 */ {"SUB E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 94 */ {"SUB H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 95 */ {"SUB L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 96 */ {"SUB M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* 97 */ {"SUB A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 98 */ {"SBB B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 99 */ {"SBB C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 9a */ {"SBB D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 9b */ {"SBB E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 9c */ {"SBB H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 9d */ {"SBB L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* 9e */ {"SBB M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* 9f */ {"SBB A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a0 */ {"ANA B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a1 */ {"ANA C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a2 */ {"ANA D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a3 */ {"ANA E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a4 */ {"ANA H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a5 */ {"ANA L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a6 */ {"ANA M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* a7 */ {"ANA A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a8 */ {"XRA B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* a9 */ {"XRA C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* aa */ {"XRA D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* ab */ {"XRA E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* ac */ {"XRA H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* ad */ {"XRA L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* ae */ {"XRA M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* af */ {"XRA A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b0 */ {"ORA B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b1 */ {"ORA C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b2 */ {"ORA D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b3 */ {"ORA E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b4 */ {"ORA H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b5 */ {"ORA L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b6 */ {"ORA M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* b7 */ {"ORA A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b8 */ {"CMP B", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* b9 */ {"CMP C", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* ba */ {"CMP D", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* bb */ {"CMP E", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* bc */ {"CMP H", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* bd */ {"CMP L", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* be */ {"CMP M", 1, 7, 7, ALL, MODE_M, RD, CTRL_NONE},
+  /* bf */ {"CMP A", 1, 4, 4, ALL, MODE_NONE, 0, CTRL_NONE},
+  /* c0 */ {"RNZ", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* c1 */ {"POP B", 1, 10, 10, 0, MODE_STACK, RD16, CTRL_NONE},
+  /* c2 */ {"JNZ", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* c3 */ {"JMP", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP},
+  /* c4 */ {"CNZ", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* c5 */ {"PUSH B", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_NONE},
+  /* c6 */ {"ADI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* c7 */ {"RST 0", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* c8 */ {"RZ", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* c9 */ {"RET", 1, 10, 10, 0, MODE_STACK, RD16, CTRL_RET},
+  /* ca */ {"JZ", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* cb */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* cc */ {"CZ", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* cd */ {"CALL", 3, 17, 17, 0, MODE_STACK, WR16, CTRL_CALL},
+  /* ce */ {"ACI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* cf */ {"RST 1", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* d0 */ {"RNC", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* d1 */ {"POP D", 1, 10, 10, 0, MODE_STACK, RD16, CTRL_NONE},
+  /* d2 */ {"JNC", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* d3 */ {"OUT", 2, 10, 10, 0, MODE_PORT, 0, CTRL_NONE},
+  /* d4 */ {"CNC", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* d5 */ {"PUSH D", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_NONE},
+  /* d6 */ {"SUI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* d7 */ {"RST 2", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* d8 */ {"RC", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* d9 */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* da */ {"JC", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* db */ {"IN", 2, 10, 10, 0, MODE_PORT, 0, CTRL_NONE},
+  /* dc */ {"CC", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* dd */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* de */ {"SBI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* df */ {"RST 3", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* e0 */ {"RPO", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* e1 */ {"POP H", 1, 10, 10, 0, MODE_STACK, RD16, CTRL_NONE},
+  /* e2 */ {"JPO", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* e3 */ {"XTHL", 1, 18, 18, 0, MODE_STACK, RW16, CTRL_NONE},
+  /* e4 */ {"CPO", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* e5 */ {"PUSH H", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_NONE},
+  /* e6 */ {"ANI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* e7 */ {"RST 4", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* e8 */ {"RPE", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* e9 */ {"PCHL", 1, 5, 5, 0, MODE_NONE, 0, CTRL_PCHL},
+  /* ea */ {"JPE", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* eb */ {"XCHG", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* ec */ {"CPE", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* ed */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* ee */ {"XRI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* ef */ {"RST 5", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* f0 */ {"RP", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* f1 */ {"POP PSW", 1, 10, 10, ALL, MODE_STACK, RD16, CTRL_NONE},
+  /* f2 */ {"JP", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* f3 */ {"DI", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* f4 */ {"CP", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* f5 */ {"PUSH PSW", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_NONE},
+  /* f6 */ {"ORI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* f7 */ {"RST 6", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+  /* f8 */ {"RM", 1, 5, 11, 0, MODE_STACK, RD16, CTRL_RET_COND},
+  /* f9 */ {"SPHL", 1, 5, 5, 0, MODE_NONE, 0, CTRL_NONE},
+  /* fa */ {"JM", 3, 10, 10, 0, MODE_IMM, 0, CTRL_JUMP_COND},
+  /* fb */ {"EI", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* fc */ {"CM", 3, 11, 17, 0, MODE_STACK, WR16, CTRL_CALL_COND},
+  /* fd */ {"NOP", 1, 4, 4, 0, MODE_NONE, 0, CTRL_NONE},
+  /* fe */ {"CPI", 2, 7, 7, ALL, MODE_IMM, 0, CTRL_NONE},
+  /* ff */ {"RST 7", 1, 11, 11, 0, MODE_STACK, WR16, CTRL_RST},
+};
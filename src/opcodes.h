@@ -0,0 +1,72 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <stdint.h>
+
+// Flags an instruction writes (on the 8080 itself, see emu.c for what the
+// core actually implements)
+#define FLAG_Z 0x01
+#define FLAG_S 0x02
+#define FLAG_P 0x04
+#define FLAG_CY 0x08
+#define FLAG_AC 0x10
+
+// Memory the instruction touches through its addressing mode
+#define MEM_READ 0x01
+#define MEM_WRITE 0x02
+#define MEM_WORD 0x04 // two bytes: LHLD/SHLD and the stack operations
+
+enum {
+  MODE_NONE,   // registers only
+  MODE_IMM,    // d8/d16 operand, including jump and call targets
+  MODE_DIRECT, // a16 memory operand (LDA, STA, LHLD, SHLD)
+  MODE_M,      // memory at HL
+  MODE_BC,     // memory at BC (LDAX B, STAX B)
+  MODE_DE,     // memory at DE (LDAX D, STAX D)
+  MODE_STACK,  // memory at SP
+  MODE_PORT,   // d8 port number (IN, OUT)
+};
+
+enum {
+  CTRL_NONE,
+  CTRL_JUMP,
+  CTRL_JUMP_COND,
+  CTRL_CALL,
+  CTRL_CALL_COND,
+  CTRL_RET,
+  CTRL_RET_COND,
+  CTRL_RST,
+  CTRL_PCHL,
+  CTRL_HALT,
+};
+
+typedef struct {
+  const char *mnemonic; // without operands, e.g. "MVI B" or "JNZ"
+  uint8_t length;
+  uint8_t cycles;       // not taken for Ccc/Rcc
+  uint8_t cycles_taken; // same as cycles for everything else
+  uint8_t flags;        // FLAG_*
+  uint8_t mode;         // MODE_*
+  uint8_t mem;          // MEM_*
+  uint8_t control;      // CTRL_*
+} OpcodeInfo;
+
+// One entry per opcode, shared by the interpreter, the recompiler, the
+// control flow analysis and the disassembler so they agree on lengths and
+// timing. The undocumented opcodes are 1 byte NOPs, as in handleOpcode.
+extern const OpcodeInfo opcodeTable[256];
+
+static inline int opcodeLength(uint8_t op) { return opcodeTable[op].length; }
+
+// Whether the instruction at pc lies wholly in the size bytes of memory;
+// one that doesn't would take its operands from past the end
+static inline int instructionFits(const uint8_t *memory, uint32_t size,
+                                  uint16_t pc) {
+  return pc < size && pc + (uint32_t)opcodeLength(memory[pc]) <= size;
+}
+
+static inline int isControlFlow(uint8_t op) {
+  return opcodeTable[op].control != CTRL_NONE;
+}
+
+#endif
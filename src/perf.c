@@ -0,0 +1,121 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf.h"
+#include "timing.h"
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} events[PERF_COUNT] = {
+    [PERF_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PERF_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE,
+                           PERF_COUNT_HW_INSTRUCTIONS},
+    [PERF_BRANCH_MISSES] = {"branch-misses", PERF_TYPE_HARDWARE,
+                            PERF_COUNT_HW_BRANCH_MISSES},
+    [PERF_L1D_MISSES] = {"L1d-misses", PERF_TYPE_HW_CACHE,
+                         PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+int perfOpen(PerfCounters *perf) {
+  int opened = 0;
+  memset(perf, 0, sizeof(PerfCounters));
+  for (int i = 0; i < PERF_COUNT; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // more events than hardware counters get multiplexed, scale them back
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    perf->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf->fds[i] < 0) {
+      perf->errors[i] = errno;
+      continue;
+    }
+    opened++;
+  }
+  return opened;
+}
+
+void perfStart(PerfCounters *perf) {
+  for (int i = 0; i < PERF_COUNT; i++) {
+    if (perf->fds[i] >= 0) {
+      ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  perf->start_ns = nowNs();
+}
+
+void perfStop(PerfCounters *perf) {
+  perf->wall_ns = nowNs() - perf->start_ns;
+  for (int i = 0; i < PERF_COUNT; i++) {
+    if (perf->fds[i] < 0)
+      continue;
+    ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    // value, time enabled, time running
+    uint64_t data[3];
+    if (read(perf->fds[i], data, sizeof(data)) != sizeof(data) ||
+        data[2] == 0) {
+      perf->values[i] = 0;
+      continue;
+    }
+    perf->values[i] = data[2] < data[1]
+                          ? (uint64_t)((double)data[0] * data[1] / data[2])
+                          : data[0];
+  }
+}
+
+void perfClose(PerfCounters *perf) {
+  for (int i = 0; i < PERF_COUNT; i++) {
+    if (perf->fds[i] >= 0)
+      close(perf->fds[i]);
+    perf->fds[i] = -1;
+  }
+}
+
+void perfReport(FILE *out, const char *engine, const PerfCounters *perf,
+                uint64_t instructions, uint64_t dispatches) {
+  double per_insn = instructions ? 1.0 / instructions : 0.0;
+  double per_dispatch = dispatches ? 1.0 / dispatches : 0.0;
+
+  fprintf(out,
+          "perf: %s engine, %" PRIu64 " 8080 instructions in %" PRIu64
+          " dispatches, %.3f ms\n",
+          engine, instructions, dispatches, perf->wall_ns / 1e6);
+  fprintf(out, "  %-14s %16s %14s %14s\n", "counter", "total",
+          "per 8080 insn", "per dispatch");
+  fprintf(out, "  %-14s %16.0f %14.3f %14.3f\n", "wall ns",
+          (double)perf->wall_ns, perf->wall_ns * per_insn,
+          perf->wall_ns * per_dispatch);
+  for (int i = 0; i < PERF_COUNT; i++) {
+    if (perf->fds[i] < 0) {
+      fprintf(out, "  %-14s %16s (%s)\n", events[i].name, "unavailable",
+              strerror(perf->errors[i]));
+      continue;
+    }
+    fprintf(out, "  %-14s %16" PRIu64 " %14.3f %14.3f\n", events[i].name,
+            perf->values[i], perf->values[i] * per_insn,
+            perf->values[i] * per_dispatch);
+  }
+  if (perf->fds[PERF_CYCLES] >= 0 && perf->fds[PERF_INSTRUCTIONS] >= 0 &&
+      perf->values[PERF_CYCLES] > 0)
+    fprintf(out, "  host IPC %.2f\n",
+            (double)perf->values[PERF_INSTRUCTIONS] /
+                perf->values[PERF_CYCLES]);
+}
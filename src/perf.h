@@ -0,0 +1,38 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Host hardware counters around the emulator's run loop, read through
+// perf_event_open. Each counter is opened on its own, user space only, so
+// a kernel or VM that lacks one (or a paranoid perf_event_paranoid setting)
+// only loses that counter; wall time is always measured.
+enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_BRANCH_MISSES,
+  PERF_L1D_MISSES,
+  PERF_COUNT
+};
+
+typedef struct {
+  int fds[PERF_COUNT]; // -1 where the counter couldn't be opened
+  uint64_t values[PERF_COUNT];
+  int errors[PERF_COUNT]; // errno from perf_event_open
+  uint64_t wall_ns;
+  uint64_t start_ns;
+} PerfCounters;
+
+// Returns how many counters could be opened
+int perfOpen(PerfCounters *perf);
+void perfStart(PerfCounters *perf);
+void perfStop(PerfCounters *perf);
+void perfClose(PerfCounters *perf);
+
+// Totals and per-emulated-instruction and per-dispatch figures for one run
+// of the named engine
+void perfReport(FILE *out, const char *engine, const PerfCounters *perf,
+                uint64_t instructions, uint64_t dispatches);
+
+#endif
@@ -0,0 +1,68 @@
+#ifdef PROFILER
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "disasm.h"
+#include "opcodes.h"
+#include "profiler.h"
+
+Profile profile;
+
+static int compareCycles(const void *a, const void *b) {
+  uint64_t x = profile.cycles[*(const uint32_t *)a];
+  uint64_t y = profile.cycles[*(const uint32_t *)b];
+  return (x < y) - (x > y);
+}
+
+static int compareOpcodes(const void *a, const void *b) {
+  uint64_t x = profile.opcodes[*(const uint32_t *)a];
+  uint64_t y = profile.opcodes[*(const uint32_t *)b];
+  return (x < y) - (x > y);
+}
+
+void profileReport(FILE *out, const uint8_t *memory, int top) {
+  static uint32_t order[0x10000];
+  uint64_t total_cycles = 0;
+  uint64_t total_hits = 0;
+  int n = 0;
+
+  for (uint32_t pc = 0; pc < 0x10000; pc++) {
+    if (profile.hits[pc] == 0)
+      continue;
+    total_cycles += profile.cycles[pc];
+    total_hits += profile.hits[pc];
+    order[n++] = pc;
+  }
+  qsort(order, n, sizeof(order[0]), compareCycles);
+
+  fprintf(out, "profile: %" PRIu64 " dispatches, %" PRIu64
+               " cycles, %d distinct pcs\n\n", total_hits, total_cycles, n);
+  fprintf(out, "  pc          hits        cycles      %%  instruction\n");
+  for (int i = 0; i < n && i < top; i++) {
+    uint16_t pc = order[i];
+    char text[DISASM_MAX];
+    disassemble(&memory[pc], text);
+    fprintf(out, "  %04x %12" PRIu64 " %13" PRIu64 " %6.2f  %s\n", pc,
+            profile.hits[pc], profile.cycles[pc],
+            total_cycles ? 100.0 * profile.cycles[pc] / total_cycles : 0.0,
+            text);
+  }
+
+  n = 0;
+  for (uint32_t op = 0; op < 256; op++) {
+    if (profile.opcodes[op])
+      order[n++] = op;
+  }
+  qsort(order, n, sizeof(order[0]), compareOpcodes);
+
+  fprintf(out, "\n  op          hits      %%  mnemonic\n");
+  for (int i = 0; i < n; i++) {
+    uint8_t op = order[i];
+    fprintf(out, "  %02x %14" PRIu64 " %6.2f  %s\n", op, profile.opcodes[op],
+            total_hits ? 100.0 * profile.opcodes[op] / total_hits : 0.0,
+            opcodeTable[op].mnemonic);
+  }
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Opcode and PC execution profiler, compiled in with -DPROFILER (the
+// PROFILER CMake option). Without it none of this exists and the run loop
+// is unchanged.
+
+#ifdef PROFILER
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+  uint64_t opcodes[256];    // dispatches per opcode
+  uint64_t hits[0x10000];   // dispatches per pc
+  uint64_t cycles[0x10000]; // clock states spent in the dispatch at pc
+} Profile;
+
+extern Profile profile;
+
+// One instruction; the run loop doesn't fuse in a profiling build
+static inline void profileStep(uint16_t pc, uint8_t opcode, uint64_t cycles) {
+  profile.opcodes[opcode]++;
+  profile.hits[pc]++;
+  profile.cycles[pc] += cycles;
+}
+
+// The top pcs by cycles, annotated with the instruction in memory, then
+// every opcode that ran by count
+void profileReport(FILE *out, const uint8_t *memory, int top);
+
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "fusion.h"
+#include "rollback.h"
+#include "romset.h"
+#include "timing.h"
+
+// bit 3 of port 1 is wired high, bit 7 is unused
+#define PORT1_MASK 0x77
+#define P2_MOVES (INVADERS_P2_SHOT | INVADERS_P2_LEFT | INVADERS_P2_RIGHT)
+
+int rollbackInit(Rollback *rb, const Snapshot *start, int local) {
+  memset(rb, 0, sizeof(Rollback));
+  rb->memory = calloc(MEMORY_SIZE, 1);
+  rb->kinds = calloc(MEMORY_SIZE, 1);
+  if (rb->memory == NULL || rb->kinds == NULL) {
+    rollbackFree(rb);
+    return 0;
+  }
+  rb->local = local;
+  rb->rollback_to = UINT32_MAX;
+  rb->registers[0] = &rb->cpu.b;
+  rb->registers[1] = &rb->cpu.c;
+  rb->registers[2] = &rb->cpu.d;
+  rb->registers[3] = &rb->cpu.e;
+  rb->registers[4] = &rb->cpu.h;
+  rb->registers[5] = &rb->cpu.l;
+  rb->registers[6] = NULL; // mem reg
+  rb->registers[7] = &rb->cpu.a;
+  rb->cpu.memory = rb->memory;
+  invadersInit(&rb->board, &rb->cpu);
+
+  // the restore leaves PAGE_ROM pages alone, so the ROM comes in here
+  memcpy(rb->memory, start->memory, MEMORY_SIZE);
+  memset(rb->cpu.dirty, 0, sizeof(rb->cpu.dirty));
+  snapshotRestore(start, &rb->cpu, &rb->board);
+  fusionPredecode(rb->memory, ROM_SIZE, rb->kinds);
+  return 1;
+}
+
+void rollbackFree(Rollback *rb) {
+  for (int i = 0; i < ROLLBACK_RING; i++) {
+    snapshotFree(&rb->states[i]);
+  }
+  free(rb->memory);
+  free(rb->kinds);
+  rb->memory = rb->kinds = NULL;
+}
+
+// Remote input for frame, the last one known held if it hasn't arrived
+static uint8_t remoteInput(const Rollback *rb, uint32_t frame, int *guessed) {
+  int slot = frame % ROLLBACK_RING;
+  *guessed = rb->remote_frame[slot] != frame + 1;
+  if (!*guessed)
+    return rb->remote_input[slot];
+  if (rb->remote_known == 0)
+    return 0;
+  return rb->remote_input[(rb->remote_known - 1) % ROLLBACK_RING];
+}
+
+static void runFrame(Rollback *rb, uint32_t frame, uint8_t remote) {
+  uint8_t p1 = rb->local == 0 ? rb->local_input[frame % ROLLBACK_RING] : remote;
+  uint8_t p2 = rb->local == 0 ? remote : rb->local_input[frame % ROLLBACK_RING];
+  rb->board.port1 = (p1 | (p2 & INVADERS_COIN) |
+                     (p2 & INVADERS_P1_START ? INVADERS_P2_START : 0)) &
+                    PORT1_MASK;
+  rb->board.port2 = p2 & P2_MOVES;
+
+  invadersRunFrame(&rb->board, &rb->cpu, rb->registers, rb->kinds, NULL);
+}
+
+// Snapshot at the start of frame. A slot is reused every ROLLBACK_RING
+// frames, so on the straight path only the pages stored to in the frames
+// since need copying; resimulated frames overwrite a slot of the timeline
+// being discarded and copy it all.
+static void saveFrame(Rollback *rb, uint32_t frame, int resimulating) {
+  Snapshot *snap = &rb->states[frame % ROLLBACK_RING];
+  if (frame > 0)
+    memcpy(rb->written[(frame - 1) % ROLLBACK_RING], rb->cpu.dirty, 0x100);
+  if (snap->memory == NULL || resimulating) {
+    snapshotTake(snap, &rb->cpu, MEMORY_SIZE, &rb->board,
+                 sizeof(InvadersBoard));
+    return;
+  }
+  for (int i = 0; i < ROLLBACK_RING; i++) {
+    for (int page = 0; page < MEMORY_SIZE >> 8; page++) {
+      rb->cpu.dirty[page] |= rb->written[i][page];
+    }
+  }
+  snapshotRetake(snap, &rb->cpu, &rb->board);
+}
+
+void rollbackSettle(Rollback *rb) {
+  uint32_t to = rb->rollback_to;
+  if (to == UINT32_MAX)
+    return;
+  rb->rollback_to = UINT32_MAX;
+  uint64_t start = nowNs();
+
+  // everything stored to since the start of frame to goes back
+  for (uint32_t frame = to; frame + 1 < rb->frame; frame++) {
+    const uint8_t *written = rb->written[frame % ROLLBACK_RING];
+    for (int page = 0; page < MEMORY_SIZE >> 8; page++) {
+      rb->cpu.dirty[page] |= written[page];
+    }
+  }
+  snapshotRestore(&rb->states[to % ROLLBACK_RING], &rb->cpu, &rb->board);
+
+  for (uint32_t frame = to; frame < rb->frame; frame++) {
+    if (frame > to)
+      saveFrame(rb, frame, 1);
+    int guessed;
+    uint8_t remote = remoteInput(rb, frame, &guessed);
+    rb->used[frame % ROLLBACK_RING] = remote;
+    runFrame(rb, frame, remote);
+  }
+
+  uint64_t ns = nowNs() - start;
+  uint32_t depth = rb->frame - to;
+  rb->rollbacks++;
+  rb->resimulated += depth;
+  if (depth > rb->max_depth)
+    rb->max_depth = depth;
+  rb->resim_ns += ns;
+  if (ns > rb->max_resim_ns)
+    rb->max_resim_ns = ns;
+  rb->over_budget += ns > ROLLBACK_BUDGET_NS;
+  histogramAdd(rb->resim_hist, ROLLBACK_BUCKETS, ROLLBACK_BUCKET_NS, ns);
+}
+
+int rollbackAdvance(Rollback *rb, uint8_t buttons) {
+  if (rb->frame >= rb->remote_known + ROLLBACK_WINDOW) {
+    rb->stalls++;
+    return 0;
+  }
+  rollbackSettle(rb);
+
+  uint32_t frame = rb->frame;
+  rb->local_input[frame % ROLLBACK_RING] = buttons;
+  saveFrame(rb, frame, 0);
+  int guessed;
+  uint8_t remote = remoteInput(rb, frame, &guessed);
+  rb->used[frame % ROLLBACK_RING] = remote;
+  rb->predicted += guessed;
+  runFrame(rb, frame, remote);
+  rb->frames_run++;
+  rb->frame++;
+  return 1;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// u32 first frame, u32 ack (first remote frame not yet received), u8
+// count, count inputs
+int rollbackPacket(const Rollback *rb, uint8_t *packet) {
+  uint32_t first = rb->local_acked;
+  uint32_t count = rb->frame - first;
+  if (count > ROLLBACK_RING)
+    count = ROLLBACK_RING;
+  put32(packet, first);
+  put32(packet + 4, rb->remote_known);
+  packet[8] = count;
+  for (uint32_t i = 0; i < count; i++) {
+    packet[9 + i] = rb->local_input[(first + i) % ROLLBACK_RING];
+  }
+  return 9 + count;
+}
+
+int rollbackReceive(Rollback *rb, const uint8_t *packet, int size) {
+  if (size < 9 || size != 9 + packet[8] || packet[8] > ROLLBACK_RING)
+    return 0;
+  uint32_t first = get32(packet);
+  uint32_t ack = get32(packet + 4);
+  if (ack > rb->local_acked && ack <= rb->frame)
+    rb->local_acked = ack;
+
+  for (uint32_t i = 0; i < packet[8]; i++) {
+    uint32_t frame = first + i;
+    if (frame < rb->remote_known)
+      continue;
+    // gaps can't happen (a packet starts at the ack), and a slot still
+    // needed for rolling back isn't overwritten
+    if (frame > rb->remote_known ||
+        frame >= rb->frame + ROLLBACK_RING - ROLLBACK_WINDOW)
+      break;
+    int slot = frame % ROLLBACK_RING;
+    uint8_t input = packet[9 + i];
+    rb->remote_input[slot] = input;
+    rb->remote_frame[slot] = frame + 1;
+    rb->remote_known = frame + 1;
+    if (frame < rb->frame && rb->used[slot] != input) {
+      rb->mispredicted++;
+      if (frame < rb->rollback_to)
+        rb->rollback_to = frame;
+    }
+  }
+  return 1;
+}
+
+uint32_t rollbackChecksum(const Rollback *rb) {
+  const CPUState *cpu = &rb->cpu;
+  uint8_t regs[] = {cpu->a,      cpu->b,      cpu->c,  cpu->d,
+                    cpu->e,      cpu->h,      cpu->l,  cpu->sp,
+                    cpu->sp >> 8, cpu->pc,    cpu->pc >> 8};
+  return crc32(rb->memory, MEMORY_SIZE) ^ crc32(regs, sizeof(regs));
+}
+
+void rollbackReport(FILE *out, const Rollback *rb) {
+  fprintf(out,
+          "rollback: %llu frames, %llu predicted, %llu mispredicted, "
+          "%llu stalls\n",
+          (unsigned long long)rb->frames_run,
+          (unsigned long long)rb->predicted,
+          (unsigned long long)rb->mispredicted,
+          (unsigned long long)rb->stalls);
+  if (rb->rollbacks == 0) {
+    fprintf(out, "  no rollbacks\n");
+    return;
+  }
+  int bucket = histogramPercentile(rb->resim_hist, ROLLBACK_BUCKETS,
+                                   rb->rollbacks, 0.99);
+  double mean = (double)rb->resim_ns / rb->rollbacks;
+  fprintf(out,
+          "  %llu rollbacks, %llu frames resimulated (%.1f per rollback, "
+          "max %u)\n",
+          (unsigned long long)rb->rollbacks,
+          (unsigned long long)rb->resimulated,
+          (double)rb->resimulated / rb->rollbacks, rb->max_depth);
+  fprintf(out,
+          "  resimulation: mean %.1f us (%.1f us a frame), p99 <%d us, "
+          "max %.1f us, %.2f%% of a frame on average, %llu over budget\n",
+          mean / 1000, (double)rb->resim_ns / rb->resimulated / 1000,
+          (bucket + 1) * ROLLBACK_BUCKET_NS / 1000, rb->max_resim_ns / 1000.0,
+          100.0 * mean / ROLLBACK_BUDGET_NS,
+          (unsigned long long)rb->over_budget);
+}
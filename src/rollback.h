@@ -0,0 +1,99 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+// Rollback netcode for two players on one Invaders board. Each peer runs
+// the whole machine. Its own buttons are applied the frame they're
+// pressed; the other player's are predicted (held as last seen) until
+// they arrive. Every frame starts with a snapshot, and when an input
+// arrives that differs from the prediction already run, the machine is
+// restored to that frame and the frames since are simulated again with
+// what is now known.
+//
+// A player's input is one byte in port 1 layout (INVADERS_COIN,
+// INVADERS_P1_START, INVADERS_P1_SHOT, _LEFT, _RIGHT). Player 2's is moved
+// onto the board's player 2 bits: start to port 1, shot and moves to
+// port 2.
+//
+// Packets carry every local input the peer hasn't acknowledged yet, so a
+// lost packet costs latency but never needs a resend. The engine only
+// builds and parses packets; moving them is the caller's (loopback.h).
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emu.h"
+#include "invaders.h"
+#include "snapshot.h"
+
+// Frames the remote input can be predicted for before the local side has
+// to wait for it
+#define ROLLBACK_WINDOW 8
+// Saved frames; more than the window so the oldest one rolled back to
+// is still there
+#define ROLLBACK_RING 16
+// 4 frame, 4 ack, 1 count, then the inputs
+#define ROLLBACK_PACKET_MAX (9 + ROLLBACK_RING)
+#define ROLLBACK_BUDGET_NS 16666667
+// Resimulation cost histogram, 10 us buckets up to 20 ms
+#define ROLLBACK_BUCKET_NS 10000
+#define ROLLBACK_BUCKETS 2000
+
+typedef struct {
+  CPUState cpu;
+  InvadersBoard board;
+  uint8_t *registers[8];
+  uint8_t *memory; // MEMORY_SIZE
+  uint8_t *kinds;  // superinstructions of the ROM, MEMORY_SIZE
+  int local;       // 0 player 1, 1 player 2
+
+  uint32_t frame;        // next frame to simulate
+  uint32_t remote_known; // remote inputs of every frame before it arrived
+  uint32_t local_acked;  // remote has every local input before it
+  uint32_t rollback_to;  // earliest mispredicted frame, UINT32_MAX if none
+
+  // indexed by frame % ROLLBACK_RING
+  uint8_t local_input[ROLLBACK_RING];
+  uint8_t remote_input[ROLLBACK_RING];
+  // frame remote_input holds + 1, 0 if none
+  uint32_t remote_frame[ROLLBACK_RING];
+  uint8_t used[ROLLBACK_RING];          // remote input the frame ran with
+  Snapshot states[ROLLBACK_RING];       // machine at the start of the frame
+  uint8_t written[ROLLBACK_RING][0x100]; // pages stored to during the frame
+
+  // cost, what the engine exists to keep small
+  uint64_t frames_run;    // first runs, not counting resimulation
+  uint64_t predicted;     // frames first run on a guessed remote input
+  uint64_t mispredicted;  // of those, guessed wrong and rolled back over
+  uint64_t rollbacks;
+  uint64_t resimulated;   // frames run again
+  uint32_t max_depth;     // most frames resimulated at once
+  uint64_t resim_ns;      // restore and resimulation, all rollbacks
+  uint64_t max_resim_ns;
+  uint64_t over_budget;   // rollbacks that took longer than a frame
+  uint64_t stalls;        // rollbackAdvance calls refused
+  uint32_t resim_hist[ROLLBACK_BUCKETS];
+} Rollback;
+
+// Both peers start from the same machine. Returns 0 if allocation fails.
+int rollbackInit(Rollback *rb, const Snapshot *start, int local);
+void rollbackFree(Rollback *rb);
+
+// Runs the next frame with the local player's buttons, rolling back first
+// if a misprediction came to light. Returns 0 without running when the
+// remote player is ROLLBACK_WINDOW frames behind; call again later.
+int rollbackAdvance(Rollback *rb, uint8_t buttons);
+// Applies a pending rollback without running a new frame
+void rollbackSettle(Rollback *rb);
+
+// Packet of the unacknowledged local inputs for the other peer, returns
+// its size
+int rollbackPacket(const Rollback *rb, uint8_t *packet);
+// Takes in a packet from the other peer; 0 if it's malformed
+int rollbackReceive(Rollback *rb, const uint8_t *packet, int size);
+
+// Machine checksum, equal on both peers once they've run the same inputs
+uint32_t rollbackChecksum(const Rollback *rb);
+
+void rollbackReport(FILE *out, const Rollback *rb);
+
+#endif
@@ -0,0 +1,134 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "romset.h"
+
+const RomChip invadersChips[INVADERS_CHIPS] = {
+    {"invaders.h", 0x0000, 0x800, 0x734f5ad8},
+    {"invaders.g", 0x0800, 0x800, 0x6bfaca4a},
+    {"invaders.f", 0x1000, 0x800, 0x0ccead96},
+    {"invaders.e", 0x1800, 0x800, 0x14e538b0},
+};
+
+uint32_t crc32(const uint8_t *data, size_t size) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+// The chips are 2 KB and a page is 4 KB, so they can't be mapped into
+// place; each is mapped, checked and copied once
+static long loadSet(const char *dir, uint8_t *memory, size_t max) {
+  int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd < 0) {
+    fprintf(stderr, "error: Couldn't open %s\n", dir);
+    return -1;
+  }
+  long end = 0;
+  for (int i = 0; i < INVADERS_CHIPS; i++) {
+    const RomChip *chip = &invadersChips[i];
+    if ((size_t)chip->addr + chip->size > max) {
+      fprintf(stderr, "error: %s doesn't fit in memory\n", chip->name);
+      close(dirfd);
+      return -1;
+    }
+    int fd = openat(dirfd, chip->name, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      fprintf(stderr, "error: Couldn't open %s/%s\n", dir, chip->name);
+      if (fd >= 0)
+        close(fd);
+      close(dirfd);
+      return -1;
+    }
+    if (st.st_size != chip->size) {
+      fprintf(stderr, "error: %s/%s is %lld bytes, expected %u\n", dir,
+              chip->name, (long long)st.st_size, chip->size);
+      close(fd);
+      close(dirfd);
+      return -1;
+    }
+    const uint8_t *data =
+        mmap(NULL, chip->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "error: Couldn't map %s/%s\n", dir, chip->name);
+      close(dirfd);
+      return -1;
+    }
+    uint32_t crc = crc32(data, chip->size);
+    if (crc != chip->crc) {
+      fprintf(stderr, "error: %s/%s has CRC32 %08x, expected %08x\n", dir,
+              chip->name, crc, chip->crc);
+      munmap((void *)data, chip->size);
+      close(dirfd);
+      return -1;
+    }
+    memcpy(&memory[chip->addr], data, chip->size);
+    munmap((void *)data, chip->size);
+    if (chip->addr + chip->size > end)
+      end = chip->addr + chip->size;
+  }
+  close(dirfd);
+  return end;
+}
+
+static long loadImage(const char *path, uint8_t *memory, size_t max) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "error: Couldn't open file %s\n", path);
+    return -1;
+  }
+  size_t size = fread(memory, 1, max, f);
+  int more = fgetc(f) != EOF;
+  fclose(f);
+  if (more) {
+    fprintf(stderr, "error: %s is larger than the %zu bytes of memory\n",
+            path, max);
+    return -1;
+  }
+  return size;
+}
+
+long romLoad(const char *path, uint8_t *memory, size_t max) {
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+    return loadSet(path, memory, max);
+  return loadImage(path, memory, max);
+}
+
+int romCheck(const char *path, const uint8_t *memory, size_t size) {
+  size_t total = 0;
+  for (int i = 0; i < INVADERS_CHIPS; i++) {
+    total += invadersChips[i].size;
+  }
+  if (size != total)
+    return 0;
+
+  int bad = 0;
+  for (int i = 0; i < INVADERS_CHIPS; i++) {
+    const RomChip *chip = &invadersChips[i];
+    if (crc32(&memory[chip->addr], chip->size) != chip->crc) {
+      fprintf(stderr, "warning: %s: %04x-%04x doesn't match %s\n", path,
+              chip->addr, chip->addr + chip->size - 1, chip->name);
+      bad++;
+    }
+  }
+  return bad;
+}
@@ -0,0 +1,32 @@
+#ifndef ROMSET_H
+#define ROMSET_H
+
+// Loading ROMs: either a directory holding the board's chip dumps, each
+// checked against a CRC32 manifest, or a single image file.
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  const char *name; // file name in the set's directory
+  uint16_t addr;    // where the chip sits in the address space
+  uint16_t size;
+  uint32_t crc;
+} RomChip;
+
+#define INVADERS_CHIPS 4
+extern const RomChip invadersChips[INVADERS_CHIPS];
+
+uint32_t crc32(const uint8_t *data, size_t size);
+
+// path is a ROM set directory or an image of at most max bytes; either is
+// loaded into memory. Returns the bytes of address space covered, or -1
+// after printing why to stderr.
+long romLoad(const char *path, uint8_t *memory, size_t max);
+
+// Image checked against the manifest: returns how many chips' worth of
+// it don't match, printing a warning for each. Images of another size
+// aren't Invaders and aren't checked.
+int romCheck(const char *path, const uint8_t *memory, size_t size);
+
+#endif
@@ -0,0 +1,80 @@
+#include <string.h>
+
+#include "runahead.h"
+#include "timing.h"
+
+static void account(RunAheadPhase *phase, uint64_t ns) {
+  phase->frames++;
+  phase->sum_ns += ns;
+  if (ns > phase->max_ns)
+    phase->max_ns = ns;
+}
+
+void runAheadInit(RunAhead *ahead, int frames) {
+  memset(ahead, 0, sizeof(RunAhead));
+  ahead->frames = frames;
+}
+
+void runAheadFree(RunAhead *ahead) { snapshotFree(&ahead->snap); }
+
+void runAheadFrame(RunAhead *ahead, CPUState *state, InvadersBoard *board,
+                   const uint8_t *kinds, uint8_t *registers[], Video *video) {
+  uint64_t start = nowNs();
+  if (ahead->taken) {
+    snapshotRetake(&ahead->snap, state, board);
+  } else {
+    snapshotTake(&ahead->snap, state, MEMORY_SIZE, board,
+                 sizeof(InvadersBoard));
+    ahead->taken = 1;
+  }
+  uint64_t saved = nowNs();
+
+  // the debugger isn't attached, so a FUSE_BREAK is never met
+  for (int frame = 0; frame < ahead->frames; frame++) {
+    if (!invadersRunFrame(board, state, registers, kinds, NULL))
+      break;
+  }
+  uint64_t ran = nowNs();
+  videoFrame(video, state->memory);
+  uint64_t presented = nowNs();
+
+  for (int page = 0; page < MEMORY_SIZE >> 8; page++) {
+    ahead->dirty_pages += state->dirty[page] != 0;
+  }
+  snapshotRestore(&ahead->snap, state, board);
+  uint64_t done = nowNs();
+
+  account(&ahead->save, saved - start);
+  account(&ahead->ahead, ran - saved);
+  account(&ahead->present, presented - ran);
+  account(&ahead->restore, done - presented);
+  uint64_t total = done - start;
+  ahead->over_budget += total > RUNAHEAD_BUDGET_NS;
+  histogramAdd(ahead->total, RUNAHEAD_BUCKETS, RUNAHEAD_BUCKET_NS, total);
+}
+
+static void printPhase(FILE *out, const char *name,
+                       const RunAheadPhase *phase) {
+  double mean = phase->frames ? (double)phase->sum_ns / phase->frames : 0;
+  fprintf(out, "  %-8s mean %9.1f us  max %9.1f us  %5.2f%% of a frame\n",
+          name, mean / 1000, phase->max_ns / 1000.0,
+          100.0 * mean / RUNAHEAD_BUDGET_NS);
+}
+
+void runAheadReport(FILE *out, const RunAhead *ahead) {
+  uint64_t n = ahead->save.frames;
+  fprintf(out, "run-ahead: %d frames ahead, %llu frames, %llu over budget\n",
+          ahead->frames, (unsigned long long)n,
+          (unsigned long long)ahead->over_budget);
+  if (n == 0)
+    return;
+  printPhase(out, "save", &ahead->save);
+  printPhase(out, "run", &ahead->ahead);
+  printPhase(out, "present", &ahead->present);
+  printPhase(out, "restore", &ahead->restore);
+
+  int bucket = histogramPercentile(ahead->total, RUNAHEAD_BUCKETS, n, 0.99);
+  fprintf(out, "  total p99 <%.2f ms, %.1f dirty pages restored per frame\n",
+          (bucket + 1) * RUNAHEAD_BUCKET_NS / 1e6,
+          (double)ahead->dirty_pages / n);
+}
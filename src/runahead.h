@@ -0,0 +1,55 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+// Run-ahead: hides the frames of lag between the game reading a button and
+// drawing the result. At each frame the machine is snapshotted, run
+// frames further with the buttons as they are now, and that future frame
+// is what gets presented; then the snapshot is restored and emulation
+// carries on from the present. Each retake and restore copies only the
+// pages dirtied since (snapshot.h).
+//
+// It costs frames+1 frames of emulation per frame shown, so every step is
+// timed against the 1/60 s a frame has.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emu.h"
+#include "invaders.h"
+#include "snapshot.h"
+#include "video.h"
+
+#define RUNAHEAD_BUDGET_NS 16666667
+// Histogram of the whole per-frame cost, 50 us buckets up to 25 ms
+#define RUNAHEAD_BUCKET_NS 50000
+#define RUNAHEAD_BUCKETS 500
+
+typedef struct {
+  uint64_t frames; // calls
+  uint64_t sum_ns;
+  uint64_t max_ns;
+} RunAheadPhase;
+
+typedef struct {
+  int frames; // how far ahead
+  Snapshot snap;
+  int taken;
+
+  RunAheadPhase save, ahead, present, restore;
+  uint64_t dirty_pages; // restored, over all frames
+  uint64_t over_budget; // frames whose run-ahead alone took a whole frame
+  uint32_t total[RUNAHEAD_BUCKETS];
+} RunAhead;
+
+void runAheadInit(RunAhead *ahead, int frames);
+void runAheadFree(RunAhead *ahead);
+
+// At a frame boundary: presents state as it will be frames from now,
+// stepping it with kinds (superinstructions, FUSE_NONE where unfused) and
+// board, then puts it back
+void runAheadFrame(RunAhead *ahead, CPUState *state, InvadersBoard *board,
+                   const uint8_t *kinds, uint8_t *registers[], Video *video);
+
+void runAheadReport(FILE *out, const RunAhead *ahead);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// A few words published by one writer and read by anyone without blocking
+// the writer: the sequence is odd while a write is in progress, and a
+// reader retries until it saw the same even sequence on both sides of
+// its copy. The words are atomics too, so a torn read is merely retried,
+// never undefined.
+#define SEQLOCK_WORDS 2
+
+typedef struct {
+  _Atomic uint32_t sequence;
+  _Atomic uint32_t words[SEQLOCK_WORDS];
+} SeqLock;
+
+static inline void seqlockWrite(SeqLock *lock, const uint32_t *value) {
+  uint32_t sequence =
+      atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+  atomic_store_explicit(&lock->sequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  for (int i = 0; i < SEQLOCK_WORDS; i++) {
+    atomic_store_explicit(&lock->words[i], value[i], memory_order_relaxed);
+  }
+  atomic_store_explicit(&lock->sequence, sequence + 2, memory_order_release);
+}
+
+// Returns the sequence the copy was taken at; it grows by 2 per write
+static inline uint32_t seqlockRead(SeqLock *lock, uint32_t *value) {
+  uint32_t before, after;
+  do {
+    before = atomic_load_explicit(&lock->sequence, memory_order_acquire);
+    for (int i = 0; i < SEQLOCK_WORDS; i++) {
+      value[i] = atomic_load_explicit(&lock->words[i], memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+  } while ((before & 1) || before != after);
+  return before;
+}
+
+#endif
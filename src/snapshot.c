@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+
+void snapshotTake(Snapshot *snap, CPUState *state, size_t memory_size,
+                  void *device, size_t device_size) {
+  if (snap->memory == NULL) {
+    snap->memory = malloc(memory_size);
+    snap->device = device_size ? malloc(device_size) : NULL;
+  }
+  snap->memory_size = memory_size;
+  snap->device_size = device_size;
+
+  memset(state->dirty, 0, sizeof(state->dirty));
+  snap->cpu = *state;
+  memcpy(snap->memory, state->memory, memory_size);
+  if (device_size)
+    memcpy(snap->device, device, device_size);
+}
+
+void snapshotRetake(Snapshot *snap, CPUState *state, void *device) {
+  for (size_t page = 0; page < snap->memory_size >> 8; page++) {
+    if (state->dirty[page])
+      memcpy(&snap->memory[page << 8], &state->memory[page << 8], 0x100);
+  }
+  memset(state->dirty, 0, sizeof(state->dirty));
+  snap->cpu = *state;
+  if (snap->device_size)
+    memcpy(snap->device, device, snap->device_size);
+}
+
+void snapshotRestore(const Snapshot *snap, CPUState *state, void *device) {
+  size_t pages = snap->memory_size >> 8;
+  // eight pages at a time: most of the map is clean
+  for (size_t first = 0; first < pages; first += 8) {
+    uint64_t any;
+    memcpy(&any, &state->dirty[first], sizeof(any));
+    if (any == 0)
+      continue;
+    for (size_t page = first; page < first + 8 && page < pages; page++) {
+      if (state->dirty[page] && !(state->page_flags[page] & PAGE_ROM))
+        memcpy(&state->memory[page << 8], &snap->memory[page << 8], 0x100);
+    }
+  }
+
+  // the saved CPUState has a clean map
+  CPUState wiring = *state;
+  *state = snap->cpu;
+  state->memory = wiring.memory;
+  state->debugger = wiring.debugger;
+  state->port_in = wiring.port_in;
+  state->port_out = wiring.port_out;
+  state->port_ctx = wiring.port_ctx;
+  memcpy(state->page_flags, wiring.page_flags, sizeof(state->page_flags));
+  if (device != NULL && snap->device_size)
+    memcpy(device, snap->device, snap->device_size);
+}
+
+void snapshotClone(const Snapshot *snap, CPUState *state, void *device) {
+  static const uint8_t zeros[0x100];
+  for (size_t page = 0; page < snap->memory_size >> 8; page++) {
+    state->dirty[page] =
+        memcmp(&snap->memory[page << 8], zeros, sizeof(zeros)) != 0;
+  }
+  snapshotRestore(snap, state, device);
+}
+
+void snapshotFree(Snapshot *snap) {
+  free(snap->memory);
+  free(snap->device);
+  memset(snap, 0, sizeof(Snapshot));
+}
@@ -0,0 +1,42 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// A saved machine to return to over and over (fuzzing, search). Taking a
+// snapshot copies all of memory and clears CPUState.dirty; restoring copies
+// back only the 256-byte pages marked dirty since, so a reset costs in
+// proportion to what the program stored, not to the size of memory.
+//
+// A restore keeps the instance's own wiring (memory, port hooks, page
+// flags, debugger), so one snapshot can reset any number of instances
+// that share a ROM (arena.h). Pages flagged PAGE_ROM are never copied.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emu.h"
+
+typedef struct {
+  CPUState cpu;
+  uint8_t *memory; // memory_size bytes
+  size_t memory_size;
+  uint8_t *device; // board state saved alongside, may be NULL
+
+  size_t device_size;
+} Snapshot;
+
+// snap must be zeroed before the first take; later takes reuse its buffers
+// (same sizes). memory_size is what state->memory holds, a multiple of 256.
+void snapshotTake(Snapshot *snap, CPUState *state, size_t memory_size,
+                  void *device, size_t device_size);
+// Takes the snapshot again, of the machine it was last taken of or
+// restored into: only the pages dirtied since are copied
+void snapshotRetake(Snapshot *snap, CPUState *state, void *device);
+// Puts state, its memory and device (device_size bytes, may be NULL) back
+// as they were at the take
+void snapshotRestore(const Snapshot *snap, CPUState *state, void *device);
+// The same for an instance whose memory is still all zeros (fresh from
+// arenaAlloc): only the snapshot's nonzero pages are copied
+void snapshotClone(const Snapshot *snap, CPUState *state, void *device);
+void snapshotFree(Snapshot *snap);
+
+#endif
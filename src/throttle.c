@@ -0,0 +1,91 @@
+#include <math.h>
+#include <string.h>
+
+#include "throttle.h"
+#include "timing.h"
+
+static uint64_t cyclesToNs(const Throttle *throttle, uint64_t cycles) {
+  return (uint64_t)(cycles * 1e9 / (CPU_HZ * throttle->speed));
+}
+
+void throttleInit(Throttle *throttle, double speed, uint64_t cycles,
+                  uint64_t slice_cycles) {
+  memset(throttle, 0, sizeof(Throttle));
+  throttle->speed = speed;
+  if (speed > 0)
+    throttle->slice_ns = cyclesToNs(throttle, slice_cycles);
+  throttle->spin_ns = throttle->slice_ns / THROTTLE_SPIN_SHARE;
+  if (throttle->spin_ns > THROTTLE_SPIN_NS)
+    throttle->spin_ns = THROTTLE_SPIN_NS;
+  throttleResync(throttle, cycles);
+}
+
+void throttleResync(Throttle *throttle, uint64_t cycles) {
+  throttle->origin_ns = nowNs();
+  throttle->origin_cycles = cycles;
+}
+
+void throttleWait(Throttle *throttle, uint64_t cycles) {
+  if (throttle->speed <= 0)
+    return;
+  uint64_t deadline =
+      throttle->origin_ns +
+      cyclesToNs(throttle, cycles - throttle->origin_cycles);
+
+  uint64_t now = nowNs();
+  if (now < deadline) {
+    if (deadline - now > throttle->spin_ns)
+      sleepUntil(deadline - throttle->spin_ns);
+    do {
+      now = nowNs();
+    } while (now < deadline);
+  } else if (now - deadline > THROTTLE_RESYNC_NS) {
+    // too far behind to catch up on: start the schedule again from here
+    throttle->resyncs++;
+    throttleResync(throttle, cycles);
+    return;
+  }
+
+  uint64_t late = now - deadline;
+  throttle->deadlines++;
+  throttle->missed += late > throttle->slice_ns;
+  if (late > throttle->late_max_ns)
+    throttle->late_max_ns = late;
+  throttle->late_sum_ns += late;
+  throttle->late_sq_sum_ns += (double)late * late;
+  histogramAdd(throttle->late, THROTTLE_BUCKETS, THROTTLE_BUCKET_NS, late);
+}
+
+// "<" the upper edge of the bucket holding the given fraction of
+// deadlines, ">=" the histogram's range past it
+static void printPercentile(FILE *out, const Throttle *throttle,
+                            const char *name, double fraction) {
+  int bucket = histogramPercentile(throttle->late, THROTTLE_BUCKETS,
+                                   throttle->deadlines, fraction);
+  if (bucket < THROTTLE_BUCKETS - 1)
+    fprintf(out, ", %s <%d us", name, (bucket + 1) * THROTTLE_BUCKET_NS / 1000);
+  else
+    fprintf(out, ", %s >=%d us", name, bucket * THROTTLE_BUCKET_NS / 1000);
+}
+
+void throttleReport(FILE *out, const Throttle *throttle) {
+  if (throttle->deadlines == 0) {
+    fprintf(out, "throttle: no deadlines\n");
+    return;
+  }
+  double n = throttle->deadlines;
+  double mean = throttle->late_sum_ns / n;
+  double var = throttle->late_sq_sum_ns / n - mean * mean;
+  fprintf(out,
+          "throttle: %gx, %llu deadlines, %llu missed by a whole slice, "
+          "%llu resyncs\n",
+          throttle->speed, (unsigned long long)throttle->deadlines,
+          (unsigned long long)throttle->missed,
+          (unsigned long long)throttle->resyncs);
+  fprintf(out, "  late by: mean %.1f us, stddev %.1f us", mean / 1000,
+          sqrt(var > 0 ? var : 0) / 1000);
+  printPercentile(out, throttle, "p50", 0.5);
+  printPercentile(out, throttle, "p99", 0.99);
+  printPercentile(out, throttle, "p99.9", 0.999);
+  fprintf(out, ", max %.1f us\n", throttle->late_max_ns / 1000.0);
+}
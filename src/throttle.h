@@ -0,0 +1,60 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+// Real-time pacing. The run loop emulates a slice of cycles (a frame or a
+// scanline) flat out, then throttleWait blocks until the wall-clock
+// instant that slice ends at 2 MHz times the speed multiplier.
+//
+// Deadlines are absolute, counted from one origin, so rounding and
+// oversleeping never add up over a long session. Falling behind is caught
+// up by not sleeping; only beyond THROTTLE_RESYNC_NS (a debugger stop, a
+// suspended host) is the origin moved instead of running flat out to
+// catch up.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define CPU_HZ 2000000
+#define CYCLES_PER_SCANLINE 127 // 262 lines at 60 Hz
+
+// clock_nanosleep wakes up this long before a deadline; the rest is spun
+// away, since the kernel timer overshoots by tens of microseconds. Never
+// more than 1/THROTTLE_SPIN_SHARE of a slice, or a scanline slice (63.5 us)
+// would spin all the time and sleep not at all.
+#define THROTTLE_SPIN_NS 100000
+#define THROTTLE_SPIN_SHARE 4
+#define THROTTLE_RESYNC_NS 250000000
+// Lateness histogram, 10 us buckets up to 20 ms, the last one catches all
+#define THROTTLE_BUCKET_NS 10000
+#define THROTTLE_BUCKETS 2000
+
+typedef struct {
+  double speed;         // multiplier of CPU_HZ, 0 never waits
+  uint64_t origin_ns;   // CLOCK_MONOTONIC when the clock read origin_cycles
+  uint64_t origin_cycles;
+  uint64_t slice_ns;    // nominal wall time of one slice, for "missed"
+  uint64_t spin_ns;     // spun before each deadline rather than slept
+
+  // how late each deadline was met, from the end of throttleWait
+  uint64_t deadlines;
+  uint64_t missed;  // later than a whole slice
+  uint64_t resyncs; // origin moved
+  uint64_t late_max_ns;
+  double late_sum_ns;
+  double late_sq_sum_ns; // for the standard deviation
+  uint32_t late[THROTTLE_BUCKETS];
+} Throttle;
+
+// Starts pacing at cycles, now. slice_cycles is how often throttleWait is
+// going to be called.
+void throttleInit(Throttle *throttle, double speed, uint64_t cycles,
+                  uint64_t slice_cycles);
+// Sleeps until the clock reaches cycles
+void throttleWait(Throttle *throttle, uint64_t cycles);
+// Moves the origin to cycles, now, e.g. after the run loop stood still
+void throttleResync(Throttle *throttle, uint64_t cycles);
+
+// Mean, deviation, percentiles and maximum of the lateness
+void throttleReport(FILE *out, const Throttle *throttle);
+
+#endif
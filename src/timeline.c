@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+#include "timeline.h"
+#include "timing.h"
+
+// A tick further apart than this (in host time) spanned a debugger stop and
+// says nothing about execution speed
+#define TICK_MAX_NS 1000000
+
+static Keyframe *keyframe(Timeline *timeline, int i) {
+  return &timeline->keyframes[(timeline->first + i) % TIMELINE_KEYFRAMES];
+}
+
+static uint8_t portIn(void *ctx, uint8_t port) {
+  Timeline *timeline = ctx;
+  const CPUState *state = timeline->state;
+  if (timeline->input < timeline->n_inputs) {
+    PortInput *logged = &timeline->inputs[timeline->input];
+    if (logged->instructions == state->instructions) {
+      timeline->input++;
+      return logged->value;
+    }
+    // not the execution that was recorded; the rest of the log is void
+    timeline->n_inputs = timeline->input;
+  }
+
+  uint8_t value = timeline->port_in != NULL
+                      ? timeline->port_in(timeline->port_ctx, port)
+                      : 0;
+  if (timeline->n_inputs == timeline->inputs_cap) {
+    timeline->inputs_cap =
+        timeline->inputs_cap ? timeline->inputs_cap * 2 : 4096;
+    timeline->inputs =
+        realloc(timeline->inputs, timeline->inputs_cap * sizeof(PortInput));
+  }
+  timeline->inputs[timeline->n_inputs++] =
+      (PortInput){state->instructions, value};
+  timeline->input = timeline->n_inputs;
+  return value;
+}
+
+static void portOut(void *ctx, uint8_t port, uint8_t value) {
+  Timeline *timeline = ctx;
+  if (timeline->port_out != NULL)
+    timeline->port_out(timeline->port_ctx, port, value);
+}
+
+// The oldest keyframe goes; so do the inputs only it could replay
+static void dropOldest(Timeline *timeline) {
+  timeline->first = (timeline->first + 1) % TIMELINE_KEYFRAMES;
+  timeline->n_keyframes--;
+
+  size_t drop = keyframe(timeline, 0)->input;
+  memmove(timeline->inputs, timeline->inputs + drop,
+          (timeline->n_inputs - drop) * sizeof(PortInput));
+  timeline->n_inputs -= drop;
+  timeline->input -= drop;
+  for (int i = 0; i < timeline->n_keyframes; i++) {
+    keyframe(timeline, i)->input -= drop;
+  }
+}
+
+static void takeKeyframe(Timeline *timeline, const CPUState *state) {
+  if (timeline->n_keyframes == TIMELINE_KEYFRAMES)
+    dropOldest(timeline);
+  Keyframe *kf = keyframe(timeline, timeline->n_keyframes++);
+  if (kf->memory == NULL)
+    kf->memory = malloc(MEMORY_SIZE + timeline->device_size);
+  kf->cpu = *state;
+  kf->input = timeline->input;
+  memcpy(kf->memory, state->memory, MEMORY_SIZE);
+  if (timeline->device != NULL)
+    memcpy(kf->memory + MEMORY_SIZE, timeline->device, timeline->device_size);
+}
+
+// Registers, flags and counters come from the keyframe; memory, hooks and
+// debugger wiring stay as they are
+static void restore(Timeline *timeline, const Keyframe *kf, CPUState *state) {
+  CPUState wiring = *state;
+  *state = kf->cpu;
+  state->memory = wiring.memory;
+  state->debugger = wiring.debugger;
+  state->port_in = wiring.port_in;
+  state->port_out = wiring.port_out;
+  state->port_ctx = wiring.port_ctx;
+  memcpy(state->page_flags, wiring.page_flags, sizeof(state->page_flags));
+  memcpy(state->dirty, wiring.dirty, sizeof(state->dirty));
+
+  // shared ROM pages (arena.h) can't be written and never change
+  for (int page = 0; page < MEMORY_SIZE >> 8; page++) {
+    if (state->page_flags[page] & PAGE_ROM)
+      continue;
+    memcpy(&state->memory[page << 8], &kf->memory[page << 8], 0x100);
+    state->dirty[page] = 1;
+  }
+  if (timeline->device != NULL)
+    memcpy(timeline->device, kf->memory + MEMORY_SIZE, timeline->device_size);
+  timeline->input = kf->input;
+}
+
+// Newest keyframe at or before instructions, -1 if there is none
+static int findKeyframe(Timeline *timeline, uint64_t instructions) {
+  int i = timeline->n_keyframes - 1;
+  while (i >= 0 && keyframe(timeline, i)->cpu.instructions > instructions) {
+    i--;
+  }
+  return i;
+}
+
+static void setReplaying(CPUState *state, int on) {
+  if (state->debugger != NULL) {
+    state->debugger->replaying = on;
+    state->debugger->watch_hit = 0;
+  }
+}
+
+// Runs forward to instructions and folds the speed into the cost estimate
+static void replay(Timeline *timeline, CPUState *state, uint64_t instructions) {
+  uint64_t start_ns = nowNs();
+  uint64_t start = state->instructions;
+  while (state->instructions < instructions) {
+    timeline->step(timeline->step_ctx, state);
+  }
+  uint64_t n = state->instructions - start;
+  if (n >= 1000) {
+    double rate = (double)(nowNs() - start_ns) / n;
+    if (rate > timeline->ns_per_insn)
+      timeline->ns_per_insn = rate;
+  }
+}
+
+void timelineAttach(Timeline *timeline, CPUState *state, TimelineStep step,
+                    void *step_ctx, void *device, size_t device_size) {
+  memset(timeline, 0, sizeof(Timeline));
+  timeline->state = state;
+  timeline->step = step;
+  timeline->step_ctx = step_ctx;
+  timeline->device = device;
+  timeline->device_size = device_size;
+  timeline->budget_ns = TIMELINE_BUDGET_NS;
+  timeline->keyframes = calloc(TIMELINE_KEYFRAMES, sizeof(Keyframe));
+
+  timeline->port_in = state->port_in;
+  timeline->port_out = state->port_out;
+  timeline->port_ctx = state->port_ctx;
+  state->port_in = portIn;
+  state->port_out = portOut;
+  state->port_ctx = timeline;
+
+  timeline->last_tick_ns = nowNs();
+  timeline->last_tick_insn = state->instructions;
+  takeKeyframe(timeline, state);
+}
+
+void timelineTick(Timeline *timeline, CPUState *state) {
+  uint64_t now = nowNs();
+  uint64_t dt = now - timeline->last_tick_ns;
+  // a reverse seek in between moves instructions backwards
+  if (state->instructions > timeline->last_tick_insn && dt < TICK_MAX_NS) {
+    // running flat out; replay is unfused and slower, which replay() learns
+    double rate = (double)dt / (state->instructions - timeline->last_tick_insn);
+    timeline->ns_per_insn = timeline->ns_per_insn > 0
+                                ? 0.9 * timeline->ns_per_insn + 0.1 * rate
+                                : rate;
+  }
+  timeline->last_tick_ns = now;
+  timeline->last_tick_insn = state->instructions;
+
+  // only the frontier gets new keyframes, a re-run of the past has them
+  const Keyframe *newest = keyframe(timeline, timeline->n_keyframes - 1);
+  if (state->instructions <= newest->cpu.instructions ||
+      timeline->ns_per_insn <= 0)
+    return;
+  if ((state->instructions - newest->cpu.instructions) *
+          timeline->ns_per_insn >=
+      timeline->budget_ns)
+    takeKeyframe(timeline, state);
+}
+
+void timelineTruncate(Timeline *timeline, const CPUState *state) {
+  while (timeline->n_keyframes > 1 &&
+         keyframe(timeline, timeline->n_keyframes - 1)->cpu.instructions >
+             state->instructions) {
+    timeline->n_keyframes--;
+  }
+  timeline->n_inputs = timeline->input;
+}
+
+int timelineSeek(Timeline *timeline, CPUState *state, uint64_t instructions) {
+  int k = findKeyframe(timeline, instructions);
+  if (k < 0)
+    return 0;
+
+  const Keyframe *kf = keyframe(timeline, k);
+  setReplaying(state, 1);
+  // going forward from a point past the keyframe needs no restore
+  if (state->instructions > instructions ||
+      state->instructions < kf->cpu.instructions)
+    restore(timeline, kf, state);
+  replay(timeline, state, instructions);
+  setReplaying(state, 0);
+  return 1;
+}
+
+int timelineReverseStep(Timeline *timeline, CPUState *state) {
+  if (state->instructions == 0)
+    return 0;
+  return timelineSeek(timeline, state, state->instructions - 1);
+}
+
+int timelineReverseContinue(Timeline *timeline, CPUState *state,
+                            Debugger *debugger) {
+  uint64_t end = state->instructions;
+  int k = end > 0 ? findKeyframe(timeline, end - 1) : -1;
+
+  setReplaying(state, 1);
+  for (; k >= 0; k--) {
+    const Keyframe *kf = keyframe(timeline, k);
+    restore(timeline, kf, state);
+
+    // the last hit in [keyframe, end)
+    int reason = -1;
+    uint64_t at = 0;
+    uint16_t watch_addr = 0, watch_pc = 0;
+    uint8_t watch_write = 0;
+    while (state->instructions < end) {
+      if (debugIsBreak(debugger, state->pc)) {
+        reason = STOP_BREAK;
+        at = state->instructions;
+      }
+      timeline->step(timeline->step_ctx, state);
+      if (debugger->watch_hit) {
+        debugger->watch_hit = 0;
+        if (state->instructions < end) {
+          reason = STOP_WATCH;
+          at = state->instructions;
+          watch_addr = debugger->watch_addr;
+          watch_pc = debugger->watch_pc;
+          watch_write = debugger->watch_write;
+        }
+      }
+    }
+
+    if (reason >= 0) {
+      restore(timeline, kf, state);
+      replay(timeline, state, at);
+      setReplaying(state, 0);
+      debugger->watch_addr = watch_addr;
+      debugger->watch_pc = watch_pc;
+      debugger->watch_write = watch_write;
+      return reason;
+    }
+    end = kf->cpu.instructions;
+  }
+
+  restore(timeline, keyframe(timeline, 0), state);
+  setReplaying(state, 0);
+  return -1;
+}
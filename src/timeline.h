@@ -0,0 +1,93 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+// Reverse execution: periodic keyframes of the whole machine plus a log of
+// every port input, so any earlier instruction boundary can be reached by
+// restoring the keyframe before it and re-executing forward. Re-executed IN
+// instructions read the log, not the device, so the replay is exact.
+//
+// Keyframes are spaced by re-execution cost, not by cycles: the timeline
+// measures how long an instruction takes to replay and keeps keyframes
+// close enough that reaching any point costs at most budget_ns of replay.
+// Positions are counted in retired instructions (CPUState.instructions).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emu.h"
+
+#define TIMELINE_BUDGET_NS 5000000
+#define TIMELINE_KEYFRAMES 1024
+
+// Runs one instruction plus whatever the machine does between instructions,
+// exactly as the run loop would (unfused: replay has to be able to stop
+// after any instruction)
+typedef void (*TimelineStep)(void *ctx, CPUState *state);
+
+typedef struct {
+  CPUState cpu;
+  uint8_t *memory; // MEMORY_SIZE bytes, then device_size bytes
+  size_t input;    // log entries consumed before this point
+} Keyframe;
+
+typedef struct {
+  uint64_t instructions; // IN retired at this position
+  uint8_t value;
+} PortInput;
+
+struct Debugger;
+
+typedef struct Timeline {
+  const CPUState *state;
+  TimelineStep step;
+  void *step_ctx;
+  // the device hooks the timeline sits in front of
+  PortIn port_in;
+  PortOut port_out;
+  void *port_ctx;
+  // device state saved with each keyframe, may be NULL
+  void *device;
+  size_t device_size;
+
+  Keyframe *keyframes; // ring, oldest at first
+  int first;
+  int n_keyframes;
+
+  PortInput *inputs;
+  size_t n_inputs;
+  size_t inputs_cap;
+  size_t input; // next entry: replaying while input < n_inputs
+
+  uint64_t budget_ns;
+  double ns_per_insn; // replay cost estimate
+  uint64_t last_tick_ns;
+  uint64_t last_tick_insn;
+} Timeline;
+
+// Installs the timeline in front of state's port hooks and takes the first
+// keyframe. step/step_ctx replay instructions.
+void timelineAttach(Timeline *timeline, CPUState *state, TimelineStep step,
+                    void *step_ctx, void *device, size_t device_size);
+
+// Called by the run loop between slices. Takes a keyframe when the replay
+// cost since the last one reaches the budget.
+void timelineTick(Timeline *timeline, CPUState *state);
+
+// The state was edited (by a debugger): the recorded future no longer
+// follows from it, drop the keyframes and inputs past this point
+void timelineTruncate(Timeline *timeline, const CPUState *state);
+
+// Moves state to the boundary after `instructions` retired instructions.
+// Returns 0 if that is before the oldest keyframe.
+int timelineSeek(Timeline *timeline, CPUState *state, uint64_t instructions);
+
+// Back one instruction. Returns 0 at the start of history.
+int timelineReverseStep(Timeline *timeline, CPUState *state);
+
+// Back to the latest breakpoint or watchpoint hit before the current
+// position. Returns a STOP_* reason, or -1 (state at the start of history)
+// if there was none.
+int timelineReverseContinue(Timeline *timeline, CPUState *state,
+                            struct Debugger *debugger);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+// Host time, for pacing (throttle.h, video.h) and for the cost reports of
+// the real-time features, whose percentiles come from fixed-width bucket
+// histograms (throttle.h, runahead.h, rollback.h).
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+
+// CLOCK_MONOTONIC in nanoseconds
+static inline uint64_t nowNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Sleeps until nowNs() reaches deadline. A signal (SIGINT) doesn't cut it
+// short; the caller notices it at its next check anyway.
+static inline void sleepUntil(uint64_t deadline) {
+  struct timespec ts = {deadline / 1000000000, deadline % 1000000000};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+// Counts ns in n buckets of bucket_ns each; the last takes everything past
+// the range
+static inline void histogramAdd(uint32_t *hist, int n, uint64_t bucket_ns,
+                                uint64_t ns) {
+  uint64_t bucket = ns / bucket_ns;
+  hist[bucket < (uint64_t)n ? bucket : (uint64_t)n - 1]++;
+}
+
+// Bucket holding the given fraction of the count samples: they are all
+// below its upper edge, unless it's the last (n - 1)
+static inline int histogramPercentile(const uint32_t *hist, int n,
+                                      uint64_t count, double fraction) {
+  uint64_t want = (uint64_t)ceil(count * fraction);
+  uint64_t seen = 0;
+  int bucket = 0;
+  while (bucket < n - 1 && (seen += hist[bucket]) < want)
+    bucket++;
+  return bucket;
+}
+
+#endif
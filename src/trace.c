@@ -0,0 +1,99 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+// The writer hands at most this many records to one fwrite
+#define DRAIN_CHUNK 4096
+
+static void drain(Tracer *tracer) {
+  size_t tail = atomic_load_explicit(&tracer->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&tracer->head, memory_order_acquire);
+  while (tail != head) {
+    size_t start = tail & tracer->mask;
+    size_t n = head - tail;
+    // contiguous part of the ring only
+    if (n > tracer->mask + 1 - start)
+      n = tracer->mask + 1 - start;
+    if (n > DRAIN_CHUNK)
+      n = DRAIN_CHUNK;
+    fwrite(&tracer->ring[start], sizeof(TraceRecord), n, tracer->file);
+    tail += n;
+    atomic_store_explicit(&tracer->tail, tail, memory_order_release);
+  }
+}
+
+static void *writer(void *arg) {
+  Tracer *tracer = arg;
+  const struct timespec idle = {0, 200000};
+
+  while (!atomic_load_explicit(&tracer->done, memory_order_acquire)) {
+    size_t tail = atomic_load_explicit(&tracer->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&tracer->head, memory_order_acquire);
+    // let records pile up so each fwrite is large
+    if (head - tail < DRAIN_CHUNK) {
+      nanosleep(&idle, NULL);
+      continue;
+    }
+    drain(tracer);
+  }
+  drain(tracer);
+  return NULL;
+}
+
+Tracer *tracerOpen(const char *path, size_t capacity) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return NULL;
+  fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), file);
+
+  size_t size = DRAIN_CHUNK;
+  while (size < capacity) {
+    size <<= 1;
+  }
+
+  // zeroed so the pad bytes written out are too
+  Tracer *tracer = calloc(1, sizeof(Tracer));
+  TraceRecord *ring = calloc(size, sizeof(TraceRecord));
+  pthread_t *thread = malloc(sizeof(pthread_t));
+  if (tracer == NULL || ring == NULL || thread == NULL)
+    goto fail;
+  tracer->ring = ring;
+  tracer->mask = size - 1;
+  tracer->file = file;
+  setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+  if (pthread_create(thread, NULL, writer, tracer) != 0)
+    goto fail;
+  tracer->thread = thread;
+  return tracer;
+
+fail:
+  free(tracer);
+  free(ring);
+  free(thread);
+  fclose(file);
+  return NULL;
+}
+
+// Only reached when the writer has fallen a whole ring behind
+void tracerWait(Tracer *tracer) {
+  tracer->stalls++;
+  size_t head = atomic_load_explicit(&tracer->head, memory_order_relaxed);
+  while (head - atomic_load_explicit(&tracer->tail, memory_order_acquire) >
+         tracer->mask) {
+    sched_yield();
+  }
+}
+
+void tracerClose(Tracer *tracer) {
+  atomic_store_explicit(&tracer->done, 1, memory_order_release);
+  pthread_join(*(pthread_t *)tracer->thread, NULL);
+  fclose(tracer->file);
+  free(tracer->thread);
+  free(tracer->ring);
+  free(tracer);
+}
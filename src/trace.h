@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emu.h"
+
+#define TRACE_MAGIC "8080TRC1"
+
+// One record per executed instruction, state before it runs. A trace file
+// is TRACE_MAGIC followed by records back to back.
+typedef struct {
+  uint64_t cycles;
+  uint16_t pc;
+  uint16_t addr; // memory touched, valid when access != 0
+  uint8_t opcode;
+  uint8_t operands[2];
+  uint8_t a;
+  uint8_t flags;  // PSW layout: S Z 0 AC 0 P 1 CY
+  uint8_t access; // MEM_* from opcodeTable
+  uint8_t pad[6];
+} TraceRecord;
+
+_Static_assert(sizeof(TraceRecord) == 24, "trace records are 24 bytes");
+
+// cc packed the way PUSH PSW stores it
+static inline uint8_t traceFlags(const CPUState *state) {
+  return (state->cc.s << 7) | (state->cc.z << 6) | (state->cc.ac << 4) |
+         (state->cc.p << 2) | 0x02 | state->cc.cy;
+}
+
+static inline void traceSetFlags(CPUState *state, uint8_t flags) {
+  state->cc.s = flags >> 7;
+  state->cc.z = flags >> 6;
+  state->cc.ac = flags >> 4;
+  state->cc.p = flags >> 2;
+  state->cc.cy = flags;
+}
+
+// Single producer (the emulation loop), single consumer (a writer thread
+// that drains the ring to the file in large writes). Neither side locks;
+// head and tail only ever grow and are masked into the ring.
+typedef struct {
+  TraceRecord *ring;
+  size_t mask;
+  _Atomic size_t head; // next record the emulator writes
+  _Atomic size_t tail; // next record the writer drains
+  _Atomic int done;
+  FILE *file;
+  void *thread; // pthread_t, kept opaque here
+  uint64_t stalls; // times the emulator waited on a full ring
+} Tracer;
+
+// capacity is rounded up to a power of two. Returns NULL if the file can't
+// be opened or the ring or writer thread can't be set up.
+Tracer *tracerOpen(const char *path, size_t capacity);
+// Drains what's left, stops the writer and closes the file
+void tracerClose(Tracer *tracer);
+
+void tracerWait(Tracer *tracer);
+
+static inline void tracerRecord(Tracer *tracer, const CPUState *state,
+                                uint16_t addr, uint8_t access) {
+  size_t head = atomic_load_explicit(&tracer->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&tracer->tail, memory_order_acquire) >
+      tracer->mask)
+    tracerWait(tracer);
+
+  TraceRecord *r = &tracer->ring[head & tracer->mask];
+  const uint8_t *code = &state->memory[state->pc];
+  r->cycles = state->cycles;
+  r->pc = state->pc;
+  r->addr = addr;
+  r->opcode = code[0];
+  r->operands[0] = code[1];
+  r->operands[1] = code[2];
+  r->a = state->a;
+  r->flags = traceFlags(state);
+  r->access = access;
+  atomic_store_explicit(&tracer->head, head + 1, memory_order_release);
+}
+
+#endif
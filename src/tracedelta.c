@@ -0,0 +1,490 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "opcodes.h"
+#include "trace.h"
+#include "tracedelta.h"
+
+#define WRITE_BUFFER (1 << 20)
+#define KEYFRAME_SIZE (1 + 8 + 8 + 2 + 2 + 9 + MEMORY_SIZE)
+#define HEADER_SIZE 16
+#define FOOTER_SIZE 24
+
+static inline uint8_t *put16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static inline uint8_t *put32(uint8_t *p, uint32_t v) {
+  p = put16(p, v);
+  return put16(p, v >> 16);
+}
+
+static inline uint8_t *put64(uint8_t *p, uint64_t v) {
+  p = put32(p, v);
+  return put32(p, v >> 32);
+}
+
+static inline uint8_t *putVarint(uint8_t *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = v | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static inline uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static inline uint64_t get64(const uint8_t *p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static inline const uint8_t *getVarint(const uint8_t *p, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0;; shift += 7) {
+    *v |= (uint64_t)(*p & 0x7f) << shift;
+    if (!(*p++ & 0x80))
+      return p;
+  }
+}
+
+// The eight registers a DELTA_REGS mask covers, in bit order
+static inline void packRegs(const CPUState *state, uint8_t flags,
+                            uint8_t *regs) {
+  regs[0] = state->a;
+  regs[1] = state->b;
+  regs[2] = state->c;
+  regs[3] = state->d;
+  regs[4] = state->e;
+  regs[5] = state->h;
+  regs[6] = state->l;
+  regs[7] = flags;
+}
+
+static inline void unpackRegs(CPUState *state, const uint8_t *regs) {
+  state->a = regs[0];
+  state->b = regs[1];
+  state->c = regs[2];
+  state->d = regs[3];
+  state->e = regs[4];
+  state->h = regs[5];
+  state->l = regs[6];
+  traceSetFlags(state, regs[7]);
+}
+
+static void flush(DeltaWriter *writer) {
+  fwrite(writer->buf, 1, writer->len, writer->file);
+  writer->offset += writer->len;
+  writer->len = 0;
+}
+
+static void writeKeyframe(DeltaWriter *writer, const CPUState *state) {
+  if (writer->len + KEYFRAME_SIZE > WRITE_BUFFER)
+    flush(writer);
+
+  if (writer->n_keyframes == writer->index_cap) {
+    writer->index_cap = writer->index_cap ? writer->index_cap * 2 : 256;
+    writer->index =
+        realloc(writer->index, writer->index_cap * 3 * sizeof(uint64_t));
+  }
+  uint64_t *entry = &writer->index[writer->n_keyframes++ * 3];
+  entry[0] = state->cycles;
+  entry[1] = writer->count;
+  entry[2] = writer->offset + writer->len;
+
+  uint8_t *p = &writer->buf[writer->len];
+  *p++ = DELTA_KEYFRAME;
+  p = put64(p, state->cycles);
+  p = put64(p, writer->count);
+  p = put16(p, state->pc);
+  p = put16(p, state->sp);
+  packRegs(state, traceFlags(state), p);
+  p += 8;
+  *p++ = state->int_enable;
+  memcpy(p, state->memory, MEMORY_SIZE);
+  p += MEMORY_SIZE;
+  writer->len = p - writer->buf;
+}
+
+DeltaWriter *deltaWriterOpen(const char *path, const CPUState *state,
+                             uint32_t interval) {
+  FILE *file = fopen(path, "wb");
+  if (file == NULL)
+    return NULL;
+
+  DeltaWriter *writer = calloc(1, sizeof(DeltaWriter));
+  writer->file = file;
+  writer->buf = malloc(WRITE_BUFFER);
+  writer->interval = interval;
+  writer->prev = *state;
+  writer->prev_flags = traceFlags(state);
+
+  uint8_t *p = writer->buf;
+  memcpy(p, DELTA_MAGIC, 8);
+  p = put32(p + 8, interval);
+  p = put32(p, MEMORY_SIZE);
+  writer->len = p - writer->buf;
+  writeKeyframe(writer, state);
+  return writer;
+}
+
+// Appends an entry for the change from writer->prev to state. cycles and pc
+// are what the reader will assume when the entry doesn't give them.
+static void writeEntry(DeltaWriter *writer, const CPUState *state,
+                       uint8_t tag, uint64_t cycles, uint16_t pc,
+                       uint16_t addr, int n_writes) {
+  // largest entry: tag, varint, pc, mask + 8 registers, sp, int, 2 writes
+  if (writer->len + 40 > WRITE_BUFFER)
+    flush(writer);
+
+  CPUState *prev = &writer->prev;
+  uint8_t *start = &writer->buf[writer->len];
+  uint8_t *p = start + 1;
+
+  if (state->cycles - prev->cycles != cycles) {
+    tag |= DELTA_CYCLES;
+    p = putVarint(p, state->cycles - prev->cycles);
+  }
+  if (state->pc != pc || (tag & DELTA_INTERRUPT)) {
+    tag |= DELTA_PC;
+    p = put16(p, state->pc);
+  }
+
+  uint8_t flags = traceFlags(state);
+  uint8_t regs[8], old[8];
+  packRegs(state, flags, regs);
+  packRegs(prev, writer->prev_flags, old);
+  uint8_t mask = 0;
+  for (int i = 0; i < 8; i++) {
+    mask |= (regs[i] != old[i]) << i;
+  }
+  if (mask) {
+    tag |= DELTA_REGS;
+    *p++ = mask;
+    for (int i = 0; i < 8; i++) {
+      if (mask & (1 << i))
+        *p++ = regs[i];
+    }
+  }
+
+  if (state->sp != prev->sp) {
+    tag |= DELTA_SP;
+    p = put16(p, state->sp);
+  }
+  if (state->int_enable != prev->int_enable) {
+    tag |= DELTA_INT;
+    *p++ = state->int_enable;
+  }
+
+  if (n_writes) {
+    tag |= DELTA_MEM;
+    *p++ = n_writes;
+    for (int i = 0; i < n_writes; i++) {
+      uint16_t at = (addr + i) & (MEMORY_SIZE - 1);
+      p = put16(p, at);
+      *p++ = state->memory[at];
+    }
+  }
+
+  *start = tag;
+  writer->len = p - writer->buf;
+  writer->prev = *state;
+  writer->prev_flags = flags;
+}
+
+void deltaWriterStep(DeltaWriter *writer, const CPUState *state,
+                     uint8_t opcode, uint16_t addr, uint8_t access) {
+  const OpcodeInfo *info = &opcodeTable[opcode];
+  // the address is the one the instruction was about to touch, before
+  // mirroring; a Ccc that wasn't taken logs the unchanged bytes, which
+  // replays harmlessly
+  int n_writes = 0;
+  if (access & MEM_WRITE)
+    n_writes = access & MEM_WORD ? 2 : 1;
+  writeEntry(writer, state, 0, info->cycles,
+             writer->prev.pc + info->length, addr, n_writes);
+
+  if (++writer->count % writer->interval == 0)
+    writeKeyframe(writer, state);
+}
+
+void deltaWriterInterrupt(DeltaWriter *writer, const CPUState *state) {
+  writeEntry(writer, state, DELTA_INTERRUPT, opcodeTable[0xc7].cycles,
+             state->pc, state->sp, 2);
+}
+
+void deltaWriterClose(DeltaWriter *writer) {
+  writer->buf[writer->len++] = DELTA_END;
+  flush(writer);
+  uint64_t index_offset = writer->offset;
+
+  uint8_t entry[24];
+  for (size_t i = 0; i < writer->n_keyframes; i++) {
+    uint8_t *p = entry;
+    for (int j = 0; j < 3; j++) {
+      p = put64(p, writer->index[i * 3 + j]);
+    }
+    fwrite(entry, 1, sizeof(entry), writer->file);
+  }
+
+  uint8_t footer[FOOTER_SIZE];
+  memcpy(footer, DELTA_INDEX_MAGIC, 8);
+  put64(put64(footer + 8, writer->n_keyframes), index_offset);
+  fwrite(footer, 1, sizeof(footer), writer->file);
+
+  fclose(writer->file);
+  free(writer->index);
+  free(writer->buf);
+  free(writer);
+}
+
+// Bytes of the entry or keyframe at p, 0 if the file ends inside it
+static size_t entrySize(const uint8_t *p, const uint8_t *end) {
+  if (*p == DELTA_END)
+    return 0;
+  if (*p == DELTA_KEYFRAME)
+    return end - p >= KEYFRAME_SIZE ? KEYFRAME_SIZE : 0;
+  const uint8_t *q = p + 1;
+  uint8_t tag = *p;
+  if (tag & DELTA_CYCLES) {
+    while (q < end && (*q & 0x80))
+      q++;
+    q++;
+  }
+  if (tag & DELTA_PC)
+    q += 2;
+  if (tag & DELTA_REGS) {
+    if (q >= end)
+      return 0;
+    q += 1 + __builtin_popcount(*q);
+  }
+  if (tag & DELTA_SP)
+    q += 2;
+  if (tag & DELTA_INT)
+    q += 1;
+  if (tag & DELTA_MEM) {
+    if (q >= end)
+      return 0;
+    q += 1 + *q * 3;
+  }
+  return q <= end ? (size_t)(q - p) : 0;
+}
+
+// A trace whose writer never finished deltaWriterClose has no index. Walks
+// the entries from the header, indexing each keyframe, up to the end marker
+// or the last entry the file holds whole. Returns the number of keyframes.
+static uint64_t scanIndex(DeltaReader *reader) {
+  const uint8_t *p = reader->data + HEADER_SIZE;
+  const uint8_t *end = reader->data + reader->size;
+  size_t cap = 256;
+  uint64_t n = 0;
+  uint8_t *index = malloc(cap * 24);
+  while (p < end) {
+    size_t size = entrySize(p, end);
+    if (size == 0)
+      break;
+    if (*p == DELTA_KEYFRAME) {
+      if (n == cap) {
+        cap *= 2;
+        index = realloc(index, cap * 24);
+      }
+      uint8_t *entry = &index[n++ * 24];
+      // cycles and instruction count as the keyframe has them
+      memcpy(entry, p + 1, 16);
+      put64(entry + 16, p - reader->data);
+    }
+    p += size;
+  }
+  reader->end = p - reader->data;
+  reader->index = reader->scanned = index;
+  return reader->n_keyframes = n;
+}
+
+DeltaReader *deltaReaderOpen(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < HEADER_SIZE) {
+    close(fd);
+    return NULL;
+  }
+
+  const uint8_t *data =
+      mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return NULL;
+
+  size_t size = st.st_size;
+  if (memcmp(data, DELTA_MAGIC, 8) != 0 ||
+      get64(data + 8) >> 32 != MEMORY_SIZE) {
+    munmap((void *)data, size);
+    return NULL;
+  }
+  madvise((void *)data, size, MADV_RANDOM);
+
+  DeltaReader *reader = calloc(1, sizeof(DeltaReader));
+  reader->data = data;
+  reader->size = size;
+
+  const uint8_t *footer = data + size - FOOTER_SIZE;
+  if (size >= HEADER_SIZE + FOOTER_SIZE &&
+      memcmp(footer, DELTA_INDEX_MAGIC, 8) == 0) {
+    uint64_t index_offset = get64(footer + 16);
+    reader->n_keyframes = get64(footer + 8);
+    reader->end = index_offset - 1;
+    reader->index = data + index_offset;
+    if (index_offset <= HEADER_SIZE ||
+        index_offset + reader->n_keyframes * 24 != size - FOOTER_SIZE ||
+        data[reader->end] != DELTA_END)
+      reader->n_keyframes = 0;
+  }
+  if (reader->n_keyframes == 0) {
+    if (scanIndex(reader) == 0) {
+      deltaReaderClose(reader);
+      return NULL;
+    }
+  }
+  return reader;
+}
+
+void deltaReaderClose(DeltaReader *reader) {
+  munmap((void *)reader->data, reader->size);
+  free(reader->scanned);
+  free(reader);
+}
+
+static void loadKeyframe(const uint8_t *p, DeltaCursor *cursor) {
+  CPUState *state = &cursor->state;
+  memset(state, 0, sizeof(CPUState));
+  state->memory = cursor->memory;
+  state->cycles = get64(p + 1);
+  cursor->count = get64(p + 9);
+  state->pc = get16(p + 17);
+  state->sp = get16(p + 19);
+  unpackRegs(state, p + 21);
+  state->int_enable = p[29];
+  memcpy(cursor->memory, p + 30, MEMORY_SIZE);
+  cursor->n_writes = 0;
+  cursor->interrupt = 0;
+}
+
+static inline uint8_t opcodeAt(const DeltaCursor *cursor) {
+  uint16_t pc = cursor->state.pc;
+  return pc < MEMORY_SIZE ? cursor->memory[pc] : 0;
+}
+
+// Cycle count after the entry at p, without applying it
+static uint64_t peekCycles(const uint8_t *p, const DeltaCursor *cursor) {
+  uint8_t opcode = p[0] & DELTA_INTERRUPT ? 0xc7 : opcodeAt(cursor);
+  uint64_t cycles = opcodeTable[opcode].cycles;
+  if (p[0] & DELTA_CYCLES)
+    getVarint(p + 1, &cycles);
+  return cursor->state.cycles + cycles;
+}
+
+int deltaNext(const DeltaReader *reader, DeltaCursor *cursor) {
+  const uint8_t *p = reader->data + cursor->offset;
+  const uint8_t *end = reader->data + reader->end;
+  // keyframes repeat the state the previous entry left, skip them
+  while (p < end && *p == DELTA_KEYFRAME) {
+    p += KEYFRAME_SIZE;
+  }
+  if (p >= end)
+    return 0;
+
+  CPUState *state = &cursor->state;
+  uint8_t tag = *p++;
+  cursor->interrupt = (tag & DELTA_INTERRUPT) != 0;
+  const OpcodeInfo *info =
+      &opcodeTable[cursor->interrupt ? 0xc7 : opcodeAt(cursor)];
+
+  uint64_t cycles = info->cycles;
+  if (tag & DELTA_CYCLES)
+    p = getVarint(p, &cycles);
+  state->cycles += cycles;
+
+  if (tag & DELTA_PC) {
+    state->pc = get16(p);
+    p += 2;
+  } else {
+    state->pc += info->length;
+  }
+
+  if (tag & DELTA_REGS) {
+    uint8_t regs[8];
+    uint8_t mask = *p++;
+    packRegs(state, traceFlags(state), regs);
+    for (int i = 0; i < 8; i++) {
+      if (mask & (1 << i))
+        regs[i] = *p++;
+    }
+    unpackRegs(state, regs);
+  }
+
+  if (tag & DELTA_SP) {
+    state->sp = get16(p);
+    p += 2;
+  }
+  if (tag & DELTA_INT)
+    state->int_enable = *p++;
+
+  cursor->n_writes = 0;
+  if (tag & DELTA_MEM) {
+    int n = *p++;
+    for (int i = 0; i < n; i++) {
+      uint16_t addr = get16(p);
+      if (addr < MEMORY_SIZE)
+        cursor->memory[addr] = p[2];
+      if (cursor->n_writes < 4)
+        cursor->writes[cursor->n_writes++] = addr;
+      p += 3;
+    }
+  }
+
+  if (!cursor->interrupt)
+    cursor->count++;
+  cursor->offset = p - reader->data;
+  return 1;
+}
+
+int deltaSeek(const DeltaReader *reader, uint64_t cycle, DeltaCursor *cursor) {
+  // last keyframe at or before cycle
+  uint64_t lo = 0, hi = reader->n_keyframes;
+  while (hi - lo > 1) {
+    uint64_t mid = (lo + hi) / 2;
+    if (get64(reader->index + mid * 24) <= cycle)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  size_t offset = get64(reader->index + lo * 24 + 16);
+  loadKeyframe(reader->data + offset, cursor);
+  cursor->offset = offset + KEYFRAME_SIZE;
+  if (cursor->state.cycles > cycle)
+    return 0;
+
+  const uint8_t *end = reader->data + reader->end;
+  while (1) {
+    const uint8_t *p = reader->data + cursor->offset;
+    while (p < end && *p == DELTA_KEYFRAME) {
+      p += KEYFRAME_SIZE;
+    }
+    if (p >= end || peekCycles(p, cursor) > cycle)
+      break;
+    cursor->offset = p - reader->data;
+    deltaNext(reader, cursor);
+  }
+  return 1;
+}
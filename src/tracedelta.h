@@ -0,0 +1,109 @@
+#ifndef TRACEDELTA_H
+#define TRACEDELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "emu.h"
+
+// Compact long-run trace. After the header the file is a stream of entries,
+// one per executed instruction or interrupt taken, each holding only what it
+// changed, with a full-state keyframe every interval instructions. An end
+// marker, a seek index of the keyframes and a fixed-size footer close the
+// file; a reader rebuilds the index of a file cut short before them.
+//
+//   header   "8080TRD3", u32 keyframe interval, u32 memory size
+//   entry    tag byte, then the fields its DELTA_* bits select, in bit order
+//   keyframe DELTA_KEYFRAME, u64 cycles, u64 instruction count, u16 pc,
+//            u16 sp, a b c d e h l, flags, int_enable, memory
+//   end      DELTA_END
+//   index    per keyframe: u64 cycles, u64 instruction count, u64 offset
+//   footer   "8080IDX1", u64 keyframes, u64 index offset
+//
+// All integers are little endian. The pc and cycle count an entry leaves
+// behind are implicit (the instruction's length and base cycle count, from
+// opcodeTable) unless its tag says otherwise. An interrupt entry always
+// gives its pc, and its implicit cycle count is RST's.
+#define DELTA_MAGIC "8080TRD3"
+#define DELTA_INDEX_MAGIC "8080IDX1"
+
+#define DELTA_CYCLES 0x01   // varint cycle delta
+#define DELTA_PC 0x02       // u16 pc
+#define DELTA_REGS 0x04     // mask byte (bit 0 a .. bit 6 l, bit 7 flags),
+                            // then the changed registers
+#define DELTA_SP 0x08       // u16 sp
+#define DELTA_INT 0x10      // u8 int_enable
+#define DELTA_MEM 0x20      // u8 count, then count u16 address/u8 value pairs
+#define DELTA_INTERRUPT 0x40 // an interrupt, not an instruction
+#define DELTA_KEYFRAME 0x80 // not an instruction, see above
+#define DELTA_END 0xff      // no more entries
+
+#define DELTA_INTERVAL 65536
+
+typedef struct {
+  FILE *file;
+  uint8_t *buf;
+  size_t len;
+  uint64_t offset; // file offset of buf[0]
+  uint32_t interval;
+  uint64_t count; // instructions recorded
+  CPUState prev;  // registers as of the last entry, memory unused
+  uint8_t prev_flags;
+  // seek index, written out at close
+  uint64_t *index;
+  size_t n_keyframes;
+  size_t index_cap;
+} DeltaWriter;
+
+// Writes the header and a keyframe of state. Returns NULL if the file can't
+// be opened.
+DeltaWriter *deltaWriterOpen(const char *path, const CPUState *state,
+                             uint32_t interval);
+// Records the instruction that just ran. opcode, addr and access (MEM_*)
+// describe it as it was before it executed, see effectiveAddress.
+void deltaWriterStep(DeltaWriter *writer, const CPUState *state,
+                     uint8_t opcode, uint16_t addr, uint8_t access);
+// Records an interrupt taken since the last entry: the return address pushed
+// and the jump to the vector
+void deltaWriterInterrupt(DeltaWriter *writer, const CPUState *state);
+// Appends the end marker and seek index and closes the file
+void deltaWriterClose(DeltaWriter *writer);
+
+typedef struct {
+  const uint8_t *data; // the mmapped file
+  size_t size;
+  size_t end; // where the entries stop and the index begins
+  const uint8_t *index;
+  uint64_t n_keyframes;
+  uint8_t *scanned; // index rebuilt by deltaReaderOpen, NULL if the file's
+} DeltaReader;
+
+// Replay position: the machine state between two instructions
+typedef struct {
+  CPUState state;
+  uint8_t memory[MEMORY_SIZE];
+  uint64_t count; // instructions executed to get here
+  size_t offset;  // next entry
+  // memory the last deltaNext wrote
+  uint16_t writes[4];
+  int n_writes;
+  uint8_t interrupt; // the last deltaNext applied an interrupt
+} DeltaCursor;
+
+// Maps a trace for reading. One cut short (the writer killed before
+// deltaWriterClose) has its index rebuilt by a scan and reads up to the last
+// whole entry. Returns NULL if the file isn't a delta trace.
+DeltaReader *deltaReaderOpen(const char *path);
+void deltaReaderClose(DeltaReader *reader);
+
+// Positions cursor at the last instruction boundary at or before cycle,
+// loading the nearest keyframe (binary search over the index) and replaying
+// forward from it. Returns 0, with cursor at the start of the trace, if cycle
+// is before it.
+int deltaSeek(const DeltaReader *reader, uint64_t cycle, DeltaCursor *cursor);
+// Applies the next instruction or interrupt. Returns 0 at the end of the
+// trace.
+int deltaNext(const DeltaReader *reader, DeltaCursor *cursor);
+
+#endif
@@ -0,0 +1,30 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "triplebuffer.h"
+
+int tripleInit(TripleBuffer *triple, size_t size) {
+  memset(triple, 0, sizeof(TripleBuffer));
+  // each on its own cache lines
+  size_t rounded = (size + 63) & ~(size_t)63;
+  for (int i = 0; i < 3; i++) {
+    triple->buffers[i] = aligned_alloc(64, rounded);
+    if (triple->buffers[i] == NULL) {
+      tripleFree(triple);
+      return 0;
+    }
+    memset(triple->buffers[i], 0, rounded);
+  }
+  triple->size = size;
+  triple->back = 0;
+  atomic_init(&triple->middle, 1);
+  triple->front = 2;
+  return 1;
+}
+
+void tripleFree(TripleBuffer *triple) {
+  for (int i = 0; i < 3; i++) {
+    free(triple->buffers[i]);
+    triple->buffers[i] = NULL;
+  }
+}
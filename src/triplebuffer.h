@@ -0,0 +1,55 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Latest-value handoff of whole frames from one producer to one consumer.
+// Of the three buffers the producer owns one (back), the consumer another
+// (front); the third sits in between. Publishing swaps back with the
+// middle, taking the newest one swaps front with it, so neither side ever
+// waits or copies. A frame the consumer didn't get to before the next
+// publish is dropped, not queued.
+#define TRIPLE_FRESH 0x04 // in middle: published since the consumer's last take
+
+typedef struct {
+  uint8_t *buffers[3];
+  size_t size;
+  _Atomic uint8_t middle; // buffer index | TRIPLE_FRESH
+  uint8_t back;           // producer's
+  uint8_t front;          // consumer's
+  uint64_t published;     // producer's count
+  uint64_t dropped;       // published over before being taken, producer's
+} TripleBuffer;
+
+// Returns 0 if the buffers can't be allocated
+int tripleInit(TripleBuffer *triple, size_t size);
+void tripleFree(TripleBuffer *triple);
+
+// Producer: the buffer to fill next, then hand it over
+static inline uint8_t *tripleBack(TripleBuffer *triple) {
+  return triple->buffers[triple->back];
+}
+
+static inline void triplePublish(TripleBuffer *triple) {
+  uint8_t old = atomic_exchange_explicit(
+      &triple->middle, triple->back | TRIPLE_FRESH, memory_order_acq_rel);
+  triple->back = old & ~TRIPLE_FRESH;
+  triple->published++;
+  triple->dropped += (old & TRIPLE_FRESH) != 0;
+}
+
+// Consumer: the newest published frame, *fresh set if it wasn't returned
+// before. Valid until the next call.
+static inline const uint8_t *tripleLatest(TripleBuffer *triple, int *fresh) {
+  *fresh = (atomic_load_explicit(&triple->middle, memory_order_relaxed) &
+            TRIPLE_FRESH) != 0;
+  if (*fresh)
+    triple->front = atomic_exchange_explicit(&triple->middle, triple->front,
+                                             memory_order_acq_rel) &
+                    ~TRIPLE_FRESH;
+  return triple->buffers[triple->front];
+}
+
+#endif
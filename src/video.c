@@ -0,0 +1,157 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "video.h"
+
+// Everything readable right now; the newest complete pair is published
+static void readInput(Video *video, uint8_t *pending, int *n_pending) {
+  uint8_t buf[512];
+  uint32_t ports[SEQLOCK_WORDS];
+  int got = 0;
+  ssize_t n;
+  while ((n = read(video->in_fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < n; i++) {
+      pending[(*n_pending)++] = buf[i];
+      if (*n_pending == 2) {
+        *n_pending = 0;
+        ports[0] = pending[0];
+        ports[1] = pending[1];
+        video->inputs++;
+        got = 1;
+      }
+    }
+  }
+  if (got)
+    seqlockWrite(&video->input, ports);
+}
+
+static void *present(void *arg) {
+  Video *video = arg;
+  uint64_t period = (uint64_t)(1e9 / video->fps);
+  uint64_t next = nowNs();
+  uint8_t pending[2];
+  int n_pending = 0;
+  while (!atomic_load_explicit(&video->done, memory_order_acquire)) {
+    next += period;
+    sleepUntil(next);
+    // a stalled reader on the pipe costs ticks, they aren't made up
+    uint64_t now = nowNs();
+    if (now > next + period)
+      next = now;
+
+    if (video->in_fd >= 0)
+      readInput(video, pending, &n_pending);
+    if (video->out != NULL) {
+      int fresh;
+      const uint8_t *frame = tripleLatest(&video->frames, &fresh);
+      if (fresh)
+        video->presented++;
+      else
+        video->repeated++;
+      fprintf(video->out, "P5 %d %d 255\n", VIDEO_WIDTH, VIDEO_HEIGHT);
+      fwrite(frame, 1, VIDEO_FRAME_SIZE, video->out);
+    }
+  }
+  return NULL;
+}
+
+Video *videoOpen(const char *out_path, const char *input_path, double fps) {
+  Video *video = calloc(1, sizeof(Video));
+  if (video == NULL) {
+    fprintf(stderr, "error: Out of memory\n");
+    return NULL;
+  }
+  video->in_fd = -1;
+  video->fps = fps;
+  if (!tripleInit(&video->frames, VIDEO_FRAME_SIZE)) {
+    fprintf(stderr, "error: Out of memory\n");
+    free(video);
+    return NULL;
+  }
+  if (out_path != NULL) {
+    video->out = fopen(out_path, "wb");
+    if (video->out == NULL) {
+      fprintf(stderr, "error: Couldn't open video output %s\n", out_path);
+      videoClose(video);
+      return NULL;
+    }
+  }
+  if (input_path != NULL) {
+    // doesn't wait for a FIFO's writer, reads never block
+    video->in_fd = open(input_path, O_RDONLY | O_NONBLOCK);
+    if (video->in_fd < 0) {
+      fprintf(stderr, "error: Couldn't open input %s: %s\n", input_path,
+              strerror(errno));
+      videoClose(video);
+      return NULL;
+    }
+  }
+
+  pthread_t *thread = malloc(sizeof(pthread_t));
+  if (thread == NULL || pthread_create(thread, NULL, present, video) != 0) {
+    fprintf(stderr, "error: Couldn't start the presentation thread\n");
+    free(thread);
+    videoClose(video);
+    return NULL;
+  }
+  video->thread = thread;
+  return video;
+}
+
+void videoStop(Video *video) {
+  if (video->thread != NULL) {
+    atomic_store_explicit(&video->done, 1, memory_order_release);
+    pthread_join(*(pthread_t *)video->thread, NULL);
+    free(video->thread);
+    video->thread = NULL;
+  }
+  if (video->out != NULL)
+    fclose(video->out);
+  if (video->in_fd >= 0)
+    close(video->in_fd);
+  video->out = NULL;
+  video->in_fd = -1;
+}
+
+void videoClose(Video *video) {
+  videoStop(video);
+  tripleFree(&video->frames);
+  free(video);
+}
+
+void videoFrame(Video *video, const uint8_t *memory) {
+  // only input: nobody would look at the frame
+  if (video->out == NULL)
+    return;
+  // 224 columns of 32 bytes, each byte eight pixels going up from the
+  // bottom of the screen
+  const uint8_t *vram = &memory[0x2400];
+  uint8_t *out = tripleBack(&video->frames);
+  for (int x = 0; x < VIDEO_WIDTH; x++) {
+    const uint8_t *column = &vram[x * 32];
+    for (int b = 0; b < 32; b++) {
+      uint8_t bits = column[b];
+      for (int k = 0; k < 8; k++) {
+        out[(VIDEO_HEIGHT - 1 - b * 8 - k) * VIDEO_WIDTH + x] =
+            (bits >> k) & 1 ? 255 : 0;
+      }
+    }
+  }
+  triplePublish(&video->frames);
+}
+
+void videoReport(FILE *out, const Video *video) {
+  fprintf(out,
+          "video: %llu frames published, %llu dropped unseen, %llu presented, "
+          "%llu repeated, %llu inputs read\n",
+          (unsigned long long)video->frames.published,
+          (unsigned long long)video->frames.dropped,
+          (unsigned long long)video->presented,
+          (unsigned long long)video->repeated,
+          (unsigned long long)video->inputs);
+}
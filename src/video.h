@@ -0,0 +1,65 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "seqlock.h"
+#include "triplebuffer.h"
+
+// Frame output and live input on a thread of their own, so the run loop
+// never waits on a file or pipe. At each vblank the emulator converts video
+// RAM into the triple buffer's back frame and publishes it; the
+// presentation thread wakes fps times a second, writes the newest frame
+// (or the previous one again) and reads input. Input travels back through
+// a seqlock the emulator polls once a frame.
+//
+// Output is a stream of binary PGM images, one per presentation tick
+// (ffmpeg -f image2pipe -c:v pgm reads it). Input is the fuzzer's format,
+// port 1 and port 2 bytes in pairs; the last complete pair read wins, so
+// a FIFO or a growing file can drive the game live.
+
+// The upright 224x256 screen, one byte per pixel, 0 or 255
+#define VIDEO_WIDTH 224
+#define VIDEO_HEIGHT 256
+#define VIDEO_FRAME_SIZE (VIDEO_WIDTH * VIDEO_HEIGHT)
+
+typedef struct {
+  TripleBuffer frames;
+  SeqLock input; // port 1, port 2
+  FILE *out;     // NULL when only reading input
+  int in_fd;     // -1 when only writing frames
+  double fps;
+  _Atomic int done;
+  void *thread; // pthread_t, kept opaque here
+
+  // the presentation thread's
+  uint64_t presented; // new frames written
+  uint64_t repeated;  // ticks with no new frame, the previous one written
+  uint64_t inputs;    // port pairs read
+} Video;
+
+// Either path may be NULL. Returns NULL, printing why to stderr, if a file
+// can't be opened or memory or the thread can't be had.
+Video *videoOpen(const char *out_path, const char *input_path, double fps);
+// Stops the presentation thread and closes both files
+void videoStop(Video *video);
+void videoClose(Video *video);
+
+// Emulator side, once a frame: converts video RAM (0x2400, rotated a
+// quarter turn) and publishes it; nothing without an output file
+void videoFrame(Video *video, const uint8_t *memory);
+// Emulator side: the latest port values, 0 until some have been read
+static inline void videoInput(Video *video, uint8_t *port1, uint8_t *port2) {
+  uint32_t ports[SEQLOCK_WORDS];
+  seqlockRead(&video->input, ports);
+  *port1 = ports[0];
+  *port2 = ports[1];
+}
+
+// Published, dropped, presented and repeated frames and inputs read; after
+// videoStop
+void videoReport(FILE *out, const Video *video);
+
+#endif
@@ -0,0 +1,161 @@
+// Differential test of everything that runs instructions other than one at
+// a time. Two machines start from one state and play the same inputs, one
+// through the superinstructions and collapsed loops (fusion.h), the other
+// through handleOpcode alone; after every frame their registers, flags,
+// clocks, board and memory must be equal. Then a snapshot (snapshot.h) is
+// restored over a run that went elsewhere and must replay the frames after
+// it exactly as they first ran.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emu.h"
+#include "fusion.h"
+#include "invaders.h"
+#include "romset.h"
+#include "snapshot.h"
+
+#define FRAMES 4000
+#define SNAPSHOT_FRAME 1500
+#define REPLAY_FRAMES 300
+
+typedef struct {
+  CPUState cpu;
+  InvadersBoard board;
+  uint8_t *registers[8];
+  uint8_t memory[MEMORY_SIZE];
+} Machine;
+
+static uint8_t kinds[MEMORY_SIZE];
+static FusionStats stats;
+
+static void machineInit(Machine *m, const char *rom_path) {
+  memset(m, 0, sizeof(Machine));
+  m->cpu.memory = m->memory;
+  m->registers[0] = &m->cpu.b;
+  m->registers[1] = &m->cpu.c;
+  m->registers[2] = &m->cpu.d;
+  m->registers[3] = &m->cpu.e;
+  m->registers[4] = &m->cpu.h;
+  m->registers[5] = &m->cpu.l;
+  m->registers[6] = NULL; // mem reg
+  m->registers[7] = &m->cpu.a;
+  invadersInit(&m->board, &m->cpu);
+  if (romLoad(rom_path, m->memory, MEMORY_SIZE) < 0)
+    exit(1);
+}
+
+// Coin and start a game every 1000 frames, then move and fire
+static uint8_t port1(int frame) {
+  int t = frame % 1000;
+  if (t >= 200 && t < 205)
+    return INVADERS_COIN;
+  if (t >= 260 && t < 264)
+    return INVADERS_P1_START;
+  static const uint8_t moves[] = {0, INVADERS_P1_LEFT, INVADERS_P1_RIGHT,
+                                  INVADERS_P1_LEFT | INVADERS_P1_SHOT,
+                                  INVADERS_P1_SHOT};
+  return moves[(frame / 9) % 5];
+}
+
+static void runFrame(Machine *m, uint8_t input, int fused) {
+  m->board.port1 = input;
+  invadersRunFrame(&m->board, &m->cpu, m->registers, fused ? kinds : NULL,
+                   fused ? &stats : NULL);
+}
+
+// Returns what differs, NULL if nothing does
+static const char *difference(const Machine *a, const Machine *b) {
+  const CPUState *x = &a->cpu, *y = &b->cpu;
+  if (x->pc != y->pc || x->sp != y->sp)
+    return "pc or sp";
+  if (x->a != y->a || x->b != y->b || x->c != y->c || x->d != y->d ||
+      x->e != y->e || x->h != y->h || x->l != y->l)
+    return "registers";
+  if (memcmp(&x->cc, &y->cc, sizeof(x->cc)) != 0)
+    return "flags";
+  if (x->int_enable != y->int_enable)
+    return "int_enable";
+  if (x->cycles != y->cycles || x->instructions != y->instructions)
+    return "clock";
+  if (x->next_event != y->next_event ||
+      memcmp(&a->board, &b->board, sizeof(a->board)) != 0)
+    return "board";
+  if (memcmp(a->memory, b->memory, MEMORY_SIZE) != 0)
+    return "memory";
+  return NULL;
+}
+
+static int report(const char *test, int frame, const Machine *a,
+                  const Machine *b) {
+  const char *what = difference(a, b);
+  if (what == NULL)
+    return 0;
+  fprintf(stderr,
+          "%s: %s differs after frame %d, pc %04x/%04x, cycles %" PRIu64
+          "/%" PRIu64 "\n",
+          test, what, frame, a->cpu.pc, b->cpu.pc, a->cpu.cycles,
+          b->cpu.cycles);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s rom|romdir\n", argv[0]);
+    return 1;
+  }
+
+  static Machine fused, plain, reference;
+  machineInit(&fused, argv[1]);
+  machineInit(&plain, argv[1]);
+  fusionPredecode(fused.memory, ROM_SIZE, kinds);
+
+  static Snapshot snap;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    if (frame == SNAPSHOT_FRAME)
+      snapshotTake(&snap, &fused.cpu, MEMORY_SIZE, &fused.board,
+                   sizeof(fused.board));
+    if (frame == SNAPSHOT_FRAME + REPLAY_FRAMES)
+      reference = fused;
+    runFrame(&fused, port1(frame), 1);
+    runFrame(&plain, port1(frame), 0);
+    if (report("fused/unfused", frame, &fused, &plain))
+      return 1;
+  }
+
+  // every collapsed loop the ROM has must have been taken
+  uint8_t present[FUSE_COUNT] = {0};
+  for (int addr = 0; addr < ROM_SIZE; addr++) {
+    present[kinds[addr]] = 1;
+  }
+  for (int kind = FUSE_NONE + 1; kind < FUSE_BREAK; kind++) {
+    printf("  %-24s %12" PRIu64 "\n", fusionName(kind), stats.hits[kind]);
+    if (kind >= FUSE_LOOP_COPY && present[kind] && stats.hits[kind] == 0) {
+      fprintf(stderr, "fused/unfused: %s never ran\n", fusionName(kind));
+      return 1;
+    }
+  }
+
+  // restore over a run that dirtied other pages, then replay
+  Machine *m = &fused;
+  for (int round = 0; round < 3; round++) {
+    snapshotRestore(&snap, &m->cpu, &m->board);
+    for (int frame = SNAPSHOT_FRAME; frame < SNAPSHOT_FRAME + REPLAY_FRAMES;
+         frame++) {
+      runFrame(m, port1(frame), round != 1);
+    }
+    if (report("snapshot restore", SNAPSHOT_FRAME + REPLAY_FRAMES - 1, m,
+               &reference))
+      return 1;
+    // go somewhere else before the next restore
+    for (int frame = 0; frame < 100 * (round + 1); frame++) {
+      runFrame(m, INVADERS_P1_SHOT | INVADERS_P1_RIGHT, 1);
+    }
+  }
+
+  snapshotFree(&snap);
+  printf("fused, unfused and restored runs agree over %d frames\n", FRAMES);
+  return 0;
+}
@@ -0,0 +1,164 @@
+// Turns a trace written by 8080emu --trace or --trace-delta into one line of
+// text per instruction: cycle, pc, bytes, disassembly, A, flags and memory
+// address. -c starts at the given cycle, -n stops after that many lines.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disasm.h"
+#include "opcodes.h"
+#include "trace.h"
+#include "tracedelta.h"
+
+#define BATCH 4096
+
+static void printFlags(char *out, uint8_t flags) {
+  out[0] = flags & 0x80 ? 'S' : '-';
+  out[1] = flags & 0x40 ? 'Z' : '-';
+  out[2] = flags & 0x10 ? 'A' : '-';
+  out[3] = flags & 0x04 ? 'P' : '-';
+  out[4] = flags & 0x01 ? 'C' : '-';
+  out[5] = '\0';
+}
+
+static void printRecord(FILE *out, const TraceRecord *r) {
+  uint8_t code[3] = {r->opcode, r->operands[0], r->operands[1]};
+  int len = opcodeLength(r->opcode);
+  char text[DISASM_MAX];
+  char flags[6];
+  disassemble(code, text);
+  printFlags(flags, r->flags);
+
+  fprintf(out, "%12" PRIu64 " %04x ", r->cycles, r->pc);
+  for (int i = 0; i < 3; i++) {
+    if (i < len)
+      fprintf(out, "%02x ", code[i]);
+    else
+      fprintf(out, "   ");
+  }
+  fprintf(out, "%-16s a=%02x %s", text, r->a, flags);
+  if (r->access)
+    fprintf(out, " %s %04x", r->access & MEM_WRITE ? "wr" : "rd", r->addr);
+  fputc('\n', out);
+}
+
+// Fixed-size records, so -c is a binary search over the file
+static int dumpRaw(FILE *in, uint64_t cycle, uint64_t count) {
+  long first = sizeof(TRACE_MAGIC) - 1;
+  fseek(in, 0, SEEK_END);
+  long lo = 0, hi = (ftell(in) - first) / (long)sizeof(TraceRecord);
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    TraceRecord r;
+    fseek(in, first + mid * (long)sizeof(TraceRecord), SEEK_SET);
+    if (fread(&r, sizeof(r), 1, in) != 1 || r.cycles >= cycle)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  fseek(in, first + lo * (long)sizeof(TraceRecord), SEEK_SET);
+
+  TraceRecord *records = malloc(BATCH * sizeof(TraceRecord));
+  size_t n;
+  while (count > 0 &&
+         (n = fread(records, sizeof(TraceRecord), BATCH, in)) > 0) {
+    for (size_t i = 0; i < n && count > 0; i++, count--) {
+      printRecord(stdout, &records[i]);
+    }
+  }
+  free(records);
+  return 0;
+}
+
+static int dumpDelta(const char *path, uint64_t cycle, uint64_t count) {
+  DeltaReader *reader = deltaReaderOpen(path);
+  if (reader == NULL) {
+    fprintf(stderr, "error: %s is a truncated or corrupt delta trace\n",
+            path);
+    return 1;
+  }
+
+  DeltaCursor *cursor = malloc(sizeof(DeltaCursor));
+  // like a raw trace, start at the first instruction at or after cycle
+  if (deltaSeek(reader, cycle, cursor) && cursor->state.cycles < cycle)
+    deltaNext(reader, cursor);
+  for (; count > 0; count--) {
+    const CPUState *state = &cursor->state;
+    TraceRecord r = {0};
+    r.cycles = state->cycles;
+    r.pc = state->pc;
+    r.opcode = state->pc < MEMORY_SIZE ? cursor->memory[state->pc] : 0;
+    for (int i = 0; i < 2; i++) {
+      uint32_t addr = state->pc + 1 + i;
+      r.operands[i] = addr < MEMORY_SIZE ? cursor->memory[addr] : 0;
+    }
+    r.a = state->a;
+    r.flags = traceFlags(state);
+    if (!deltaNext(reader, cursor))
+      break;
+    // the board jams an RST onto the bus, so an interrupt lists as one
+    if (cursor->interrupt)
+      r.opcode = 0xc7 | (cursor->state.pc & 0x38);
+    if (cursor->n_writes > 0) {
+      r.access = MEM_WRITE;
+      r.addr = cursor->writes[0];
+    }
+    printRecord(stdout, &r);
+  }
+  free(cursor);
+  deltaReaderClose(reader);
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-c cycle] [-n count] trace\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t cycle = 0;
+  uint64_t count = UINT64_MAX;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+    switch (opt) {
+    case 'c':
+      cycle = strtoull(optarg, NULL, 0);
+      break;
+    case 'n':
+      count = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+
+  const char *path = argv[optind];
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    fprintf(stderr, "error: Couldn't open file %s\n", path);
+    return 1;
+  }
+
+  char magic[sizeof(TRACE_MAGIC) - 1];
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic)) {
+    fprintf(stderr, "error: %s is not an 8080 trace\n", path);
+    return 1;
+  }
+
+  int status;
+  if (memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+    status = dumpRaw(in, cycle, count);
+  } else if (memcmp(magic, DELTA_MAGIC, sizeof(magic)) == 0) {
+    status = dumpDelta(path, cycle, count);
+  } else {
+    fprintf(stderr, "error: %s is not an 8080 trace\n", path);
+    status = 1;
+  }
+  fclose(in);
+  return status;
+}